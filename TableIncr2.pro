@@ -1,23 +1,15 @@
-QT += widgets sql
-
-greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
-
-CONFIG += c++17
-
-# You can make your code fail to compile if it uses deprecated APIs.
-# In order to do so, uncomment the following line.
-#DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
-
-SOURCES += \
-    main.cpp \
-    mainwindow.cpp
-
-HEADERS += \
-    mainwindow.h
-
-CONFIG += lrelease
-
-# Default rules for deployment.
-qnx: target.path = /tmp/$${TARGET}/bin
-else: unix:!android: target.path = /opt/$${TARGET}/bin
-!isEmpty(target.path): INSTALLS += target
+# engine: static library with the counters, workers and persistence.
+# gui:    the Qt Widgets app (TableIncr2).
+# cli:    headless driver (tableincr-cli) for servers and throughput runs.
+# tests:  persistence and counter manager tests, run with `make check`.
+TEMPLATE = subdirs
+
+SUBDIRS = \
+    engine \
+    gui \
+    cli \
+    tests
+
+gui.depends = engine
+cli.depends = engine
+tests.depends = engine
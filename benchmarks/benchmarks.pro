@@ -0,0 +1,28 @@
+QT = core sql
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = counterbench
+
+INCLUDEPATH += ..
+
+SOURCES += \
+    main.cpp \
+    ../countermanager.cpp \
+    ../slotindex.cpp \
+    ../counterkernels.cpp \
+    ../counterstore.cpp \
+    ../chunkedcounterstore.cpp \
+    ../mappedcounterstore.cpp \
+    ../sqliteprofile.cpp
+
+HEADERS += \
+    ../countermanager.h \
+    ../slotindex.h \
+    ../counterkernels.h \
+    ../counterbackend.h \
+    ../counterstore.h \
+    ../chunkedcounterstore.h \
+    ../mappedcounterstore.h \
+    ../sqliteprofile.h
@@ -0,0 +1,383 @@
+#include "countermanager.h"
+#include "counterkernels.h"
+#include "counterstore.h"
+#include "chunkedcounterstore.h"
+#include "mappedcounterstore.h"
+#include "sqliteprofile.h"
+
+#include <QCoreApplication>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QStringList>
+#include <QTemporaryDir>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <numeric>
+#include <thread>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Keeps reader-side work observable so the compiler cannot drop it.
+volatile long long g_sink = 0;
+
+enum class ReaderKind { None, LockedCopy };
+
+const char *readerName(ReaderKind kind) {
+    switch (kind) {
+    case ReaderKind::None: return "none";
+    case ReaderKind::LockedCopy: return "getCounters";
+    }
+    return "?";
+}
+
+// Runs incrementAll() back to back for `duration` while a reader thread
+// polls the counters every `readerPeriod`, the way the table and frequency
+// timers do. Returns increment passes per second.
+double measureIncrementRate(CounterManager::StorageMode mode, int counterCount,
+                            ReaderKind reader, std::chrono::milliseconds readerPeriod,
+                            std::chrono::milliseconds duration) {
+    CounterManager manager(mode);
+    manager.setCounters(std::vector<CounterManager::Value>(counterCount, 0));
+
+    std::atomic<bool> running{true};
+    std::thread readerThread([&]() {
+        long long sink = 0;
+        while (running.load()) {
+            if (reader == ReaderKind::LockedCopy) {
+                std::vector<CounterManager::Value> counters = manager.getCounters();
+                sink += std::accumulate(counters.begin(), counters.end(), 0LL);
+            }
+            std::this_thread::sleep_for(readerPeriod);
+        }
+        g_sink = sink;
+    });
+
+    long long passes = 0;
+    const Clock::time_point start = Clock::now();
+    const Clock::time_point stop = start + duration;
+    Clock::time_point now = start;
+    while (now < stop) {
+        manager.incrementAll();
+        ++passes;
+        if ((passes & 15) == 0) now = Clock::now();
+    }
+    now = Clock::now();
+
+    running.store(false);
+    readerThread.join();
+
+    return passes / std::chrono::duration<double>(now - start).count();
+}
+
+void benchReaders() {
+    std::printf("== incrementAll throughput under concurrent readers ==\n");
+    std::printf("%10s %8s %12s %14s\n", "counters", "period", "reader", "passes/s");
+
+    const int sizes[] = {10000, 100000, 1000000};
+    const std::chrono::milliseconds periods[] = {std::chrono::milliseconds(100),
+                                                 std::chrono::milliseconds(1)};
+    for (int size : sizes) {
+        for (auto period : periods) {
+            for (ReaderKind kind : {ReaderKind::None, ReaderKind::LockedCopy}) {
+                double rate = measureIncrementRate(CounterManager::StorageMode::Locked, size, kind,
+                                                   period, std::chrono::milliseconds(1000));
+                std::printf("%10d %6lldms %12s %14.0f\n", size,
+                            static_cast<long long>(period.count()), readerName(kind), rate);
+            }
+        }
+    }
+}
+
+// Compares the two storage modes while a second thread keeps adding and
+// deleting counters, which contends with incrementAll() for the lock.
+void benchStorageModes() {
+    std::printf("== incrementAll throughput per storage mode with structural edits ==\n");
+    std::printf("%10s %8s %14s %14s\n", "counters", "mode", "passes/s", "edits/s");
+
+    const int sizes[] = {100000, 1000000};
+    for (int size : sizes) {
+        for (auto mode : {CounterManager::StorageMode::Locked, CounterManager::StorageMode::Atomic}) {
+            CounterManager manager(mode);
+            manager.setCounters(std::vector<CounterManager::Value>(size, 0));
+
+            std::atomic<bool> running{true};
+            std::atomic<long long> edits{0};
+            std::thread editor([&]() {
+                while (running.load()) {
+                    manager.addCounter(0);
+                    manager.deleteCounter(manager.count() - 1);
+                    edits.fetch_add(2, std::memory_order_relaxed);
+                    g_sink = g_sink + manager.counterAt(size / 2);
+                    std::this_thread::yield();
+                }
+            });
+
+            long long passes = 0;
+            const Clock::time_point start = Clock::now();
+            const Clock::time_point stop = start + std::chrono::milliseconds(1000);
+            while (Clock::now() < stop) {
+                manager.incrementAll();
+                ++passes;
+            }
+            const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+            running.store(false);
+            editor.join();
+
+            std::printf("%10d %8s %14.0f %14.0f\n", size,
+                        mode == CounterManager::StorageMode::Locked ? "locked" : "atomic",
+                        passes / seconds, edits.load() / seconds);
+        }
+    }
+}
+
+// Original incrementAll() loop, kept as the baseline for the kernels.
+void rangeForIncrement(std::vector<CounterManager::Value>& counters) {
+    for (auto& counter : counters) {
+        ++counter;
+    }
+}
+
+template <typename Fn>
+double nanosPerElement(std::size_t count, Fn&& fn) {
+    const std::size_t reps = std::max<std::size_t>(3, 100000000 / std::max<std::size_t>(count, 1));
+    const Clock::time_point start = Clock::now();
+    for (std::size_t r = 0; r < reps; ++r) {
+        fn();
+    }
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    return seconds * 1e9 / (static_cast<double>(reps) * count);
+}
+
+void benchKernels() {
+    using CounterKernels::Isa;
+    std::printf("== increment / sum kernels (ns per counter), active: %s ==\n",
+                CounterKernels::isaName(CounterKernels::active().isa));
+    std::printf("%10s %10s %10s %10s\n", "counters", "kernel", "add", "sum");
+
+    const std::size_t sizes[] = {16, 1000, 100000, 1000000, 10000000};
+    for (std::size_t size : sizes) {
+        std::vector<CounterManager::Value> counters(size, 1);
+
+        double add = nanosPerElement(size, [&]() { rangeForIncrement(counters); });
+        double sum = nanosPerElement(size, [&]() {
+            g_sink = g_sink + std::accumulate(counters.begin(), counters.end(), 0LL);
+        });
+        std::printf("%10zu %10s %10.3f %10.3f\n", size, "range-for", add, sum);
+
+        for (Isa isa : {Isa::Scalar, Isa::Sse2, Isa::Avx2, Isa::Avx512}) {
+            const CounterKernels::Table *table = CounterKernels::forIsa(isa);
+            if (!table) continue;
+            add = nanosPerElement(size, [&]() { table->add(counters.data(), size, 1); });
+            sum = nanosPerElement(size, [&]() {
+                g_sink = g_sink + table->sum(counters.data(), size);
+            });
+            std::printf("%10zu %10s %10.3f %10.3f\n", size, CounterKernels::isaName(isa), add, sum);
+        }
+    }
+}
+
+// The original onSaveClicked(): wipe the table and insert every value.
+void legacySave(QSqlDatabase &db, const CounterManager &manager) {
+    QSqlQuery query(db);
+    query.exec("BEGIN TRANSACTION");
+    query.exec("DELETE FROM counters");
+
+    std::vector<CounterManager::Value> counters = manager.getCounters();
+    query.prepare("INSERT INTO counters (id, value) VALUES (?, ?)");
+    for (std::size_t i = 0; i < counters.size(); ++i) {
+        query.bindValue(0, static_cast<qlonglong>(i + 1));
+        query.bindValue(1, static_cast<qlonglong>(counters[i]));
+        query.exec();
+    }
+
+    query.exec("COMMIT");
+}
+
+double millisecondsFor(const std::function<void()> &fn) {
+    const Clock::time_point start = Clock::now();
+    fn();
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+void benchSave() {
+    std::printf("== save latency (ms): full rewrite vs incremental ==\n");
+    std::printf("%10s %12s %14s %14s %14s\n",
+                "counters", "full", "incr 0%", "incr 1%", "incr 100%");
+
+    QTemporaryDir dir;
+    const int sizes[] = {10000, 100000, 1000000};
+    for (int size : sizes) {
+        const QString connection = QString("bench-save-%1").arg(size);
+        {
+            QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", connection);
+            db.setDatabaseName(dir.filePath(connection + ".db"));
+            db.open();
+
+            CounterManager manager;
+            manager.setCounters(std::vector<CounterManager::Value>(size, 0));
+            CounterStore store(connection);
+            store.save(manager);
+
+            const double full = millisecondsFor([&]() { legacySave(db, manager); });
+            store.invalidate();
+            store.save(manager);
+
+            const double unchanged = millisecondsFor([&]() { store.save(manager); });
+
+            std::vector<CounterManager::Value> values = manager.getCounters();
+            for (std::size_t i = 0; i < values.size(); i += 100) {
+                ++values[i];
+            }
+            manager.setCounters(values);
+            const double onePercent = millisecondsFor([&]() { store.save(manager); });
+
+            manager.incrementAll();
+            const double everything = millisecondsFor([&]() { store.save(manager); });
+
+            std::printf("%10d %12.1f %14.1f %14.1f %14.1f\n",
+                        size, full, unchanged, onePercent, everything);
+            db.close();
+        }
+        QSqlDatabase::removeDatabase(connection);
+    }
+}
+
+struct BackendTimes {
+    double fullSave;
+    double onePercentSave;
+    double load;
+};
+
+// Save and load latency (ms) of one backend, starting from an empty store.
+BackendTimes measureBackend(CounterBackend &backend, int size) {
+    CounterManager manager;
+    manager.setCounters(std::vector<CounterManager::Value>(size, 0));
+    BackendTimes times;
+    times.fullSave = millisecondsFor([&]() { backend.save(manager); });
+
+    std::vector<CounterManager::Value> values = manager.getCounters();
+    for (std::size_t i = 0; i < values.size(); i += 100) {
+        ++values[i];
+    }
+    manager.setCounters(values);
+    times.onePercentSave = millisecondsFor([&]() { backend.save(manager); });
+
+    CounterManager loaded;
+    times.load = millisecondsFor([&]() { backend.load(loaded); });
+    return times;
+}
+
+void benchBackend(const char *name, CounterBackend &backend, int size) {
+    const BackendTimes times = measureBackend(backend, size);
+    std::printf("%10d %8s %10.1f %10.1f %10.1f\n", size, name,
+                times.fullSave, times.onePercentSave, times.load);
+}
+
+// Load and save latency of the persistence backends.
+void benchBackends() {
+    std::printf("== backend latency (ms): sqlite rows vs chunks vs mapped ==\n");
+    std::printf("%10s %8s %10s %10s %10s\n", "counters", "backend", "full save", "incr 1%", "load");
+
+    QTemporaryDir dir;
+    const int sizes[] = {100000, 1000000};
+    for (int size : sizes) {
+        // Separate databases: the chunked store migrates away a `counters`
+        // table it finds.
+        const QString rows = QString("bench-rows-%1").arg(size);
+        const QString chunks = QString("bench-chunks-%1").arg(size);
+        for (const QString &connection : {rows, chunks}) {
+            QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", connection);
+            db.setDatabaseName(dir.filePath(connection + ".db"));
+            db.open();
+        }
+
+        {
+            // Scoped: the stores hold prepared statements on the connections.
+            CounterStore rowStore(rows);
+            benchBackend("sqlite", rowStore, size);
+            ChunkedCounterStore chunkStore(chunks);
+            benchBackend("chunked", chunkStore, size);
+            MappedCounterStore mappedStore(dir.filePath(QString("bench-mapped-%1.bin").arg(size)));
+            benchBackend("mapped", mappedStore, size);
+        }
+
+        for (const QString &connection : {rows, chunks}) {
+            QSqlDatabase::database(connection, false).close();
+            QSqlDatabase::removeDatabase(connection);
+        }
+    }
+}
+
+// Save and load throughput of the SQLite backends under each PRAGMA
+// profile, in million counters per second.
+void benchProfiles() {
+    std::printf("== SQLite profiles (M counters/s) ==\n");
+    std::printf("%10s %9s %8s %10s %10s %10s\n",
+                "counters", "profile", "schema", "full save", "incr 1%", "load");
+
+    QTemporaryDir dir;
+    const int sizes[] = {100000, 1000000};
+    for (int size : sizes) {
+        for (const QString &profileName : SqliteProfile::names()) {
+            SqliteProfile profile;
+            SqliteProfile::fromName(profileName, &profile);
+            for (bool chunked : {false, true}) {
+                const QString connection = QString("bench-%1-%2-%3")
+                                               .arg(profileName, chunked ? "chunks" : "rows")
+                                               .arg(size);
+                {
+                    QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", connection);
+                    db.setDatabaseName(dir.filePath(connection + ".db"));
+                    db.open();
+                    profile.apply(db);
+
+                    std::unique_ptr<CounterBackend> store;
+                    if (chunked) {
+                        store = std::make_unique<ChunkedCounterStore>(connection);
+                    } else {
+                        store = std::make_unique<CounterStore>(connection);
+                    }
+                    const BackendTimes times = measureBackend(*store, size);
+                    store.reset();
+
+                    // The 1% save still diffs every counter, so its rate is
+                    // counted over all of them like the others.
+                    auto rate = [size](double ms) { return size / (ms * 1e3); };
+                    std::printf("%10d %9s %8s %10.2f %10.2f %10.2f\n", size,
+                                qPrintable(profileName), chunked ? "chunks" : "rows",
+                                rate(times.fullSave), rate(times.onePercentSave), rate(times.load));
+                    db.close();
+                }
+                QSqlDatabase::removeDatabase(connection);
+            }
+        }
+    }
+}
+
+} // namespace
+
+// Usage: counterbench [readers] [storage] [kernels] [save] [backends] [profiles]
+// Without arguments every group runs.
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    const QStringList groups = app.arguments().mid(1);
+    auto wanted = [&](const char *group) {
+        return groups.isEmpty() || groups.contains(QLatin1String(group));
+    };
+
+    if (wanted("readers")) benchReaders();
+    if (wanted("storage")) benchStorageModes();
+    if (wanted("kernels")) benchKernels();
+    if (wanted("save")) benchSave();
+    if (wanted("backends")) benchBackends();
+    if (wanted("profiles")) benchProfiles();
+    return 0;
+}
@@ -0,0 +1,263 @@
+#include "countermanager.h"
+#include "counterkernels.h"
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+// Google Benchmark suite for the CounterManager API. Every benchmark takes
+// (storage mode, counter count, concurrent readers) and reports
+// items_per_second, counted per counter for whole-array operations.
+//
+//     ./managerbench --benchmark_filter=IncrementAll
+//     ./managerbench --benchmark_out=baseline.json --benchmark_out_format=json
+//
+// Two JSON files can be diffed with tools/compare.py from the Google
+// Benchmark sources.
+
+namespace {
+
+CounterManager::StorageMode modeArg(const benchmark::State &state) {
+    return state.range(0) == 0 ? CounterManager::StorageMode::Locked
+                               : CounterManager::StorageMode::Atomic;
+}
+
+void fill(CounterManager &manager, int64_t count) {
+    manager.setCounters(std::vector<CounterManager::Value>(count, 1));
+}
+
+// Threads that keep copying all counters and summing them, with no pause in
+// between. Running flat out makes them the worst case the measured
+// operation can see.
+class Readers {
+public:
+    Readers(const CounterManager &manager, int64_t count) {
+        for (int64_t i = 0; i < count; ++i) {
+            threads_.emplace_back([this, &manager]() {
+                while (running_.load(std::memory_order_relaxed)) {
+                    const std::vector<CounterManager::Value> counters = manager.getCounters();
+                    benchmark::DoNotOptimize(
+                        CounterKernels::active().sum(counters.data(), counters.size()));
+                }
+            });
+        }
+    }
+
+    ~Readers() {
+        running_.store(false, std::memory_order_relaxed);
+        for (std::thread &thread : threads_) {
+            thread.join();
+        }
+    }
+
+private:
+    std::atomic<bool> running_{true};
+    std::vector<std::thread> threads_;
+};
+
+void setLabel(benchmark::State &state) {
+    state.SetLabel(state.range(0) == 0 ? "locked" : "atomic");
+}
+
+void BM_AddCounter(benchmark::State &state) {
+    const int64_t count = state.range(1);
+    CounterManager manager(modeArg(state));
+    fill(manager, count);
+    Readers readers(manager, state.range(2));
+
+    for (auto _ : state) {
+        manager.addCounter(0);
+        // Keep the size around `count` so every size measures itself.
+        if (manager.count() >= 2 * count) {
+            state.PauseTiming();
+            fill(manager, count);
+            state.ResumeTiming();
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+    setLabel(state);
+}
+
+void BM_DeleteCounter(benchmark::State &state) {
+    const int64_t count = state.range(1);
+    CounterManager manager(modeArg(state));
+    fill(manager, count);
+    Readers readers(manager, state.range(2));
+
+    for (auto _ : state) {
+        // The middle row. Nothing shifts: the delete leaves a tombstone,
+        // so this measures the O(log n) row lookup and index bookkeeping.
+        manager.deleteCounter(manager.count() / 2);
+        if (manager.count() <= count / 2) {
+            state.PauseTiming();
+            fill(manager, count);
+            state.ResumeTiming();
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+    setLabel(state);
+}
+
+// Deleting row 0 of 1M counters, which once shifted every counter behind
+// it and now only leaves a tombstone like any other row.
+// With a compactor thread the tombstones are reclaimed while deleting, the
+// way CounterEngine runs it.
+void BM_DeleteFront(benchmark::State &state) {
+    const int64_t count = 1000000;
+    CounterManager manager(modeArg(state));
+    fill(manager, count);
+
+    std::atomic<bool> compacting{state.range(1) != 0};
+    std::thread compactor([&]() {
+        while (compacting.load(std::memory_order_relaxed)) {
+            if (!manager.compactStep()) std::this_thread::yield();
+        }
+    });
+
+    for (auto _ : state) {
+        manager.deleteCounter(0);
+        if (manager.count() <= count / 2) {
+            state.PauseTiming();
+            fill(manager, count);
+            state.ResumeTiming();
+        }
+    }
+    compacting.store(false, std::memory_order_relaxed);
+    compactor.join();
+    state.SetItemsProcessed(state.iterations());
+    setLabel(state);
+}
+
+// Adds while shard workers run flat out, as CounterEngine's free-running
+// mode does. In atomic mode each pass re-takes the shared structure lock,
+// so this shows whether writers still get their turn.
+void BM_AddWhileIncrementing(benchmark::State &state) {
+    const int64_t count = 100000;
+    const std::size_t workers = static_cast<std::size_t>(state.range(1));
+    CounterManager manager(modeArg(state));
+    fill(manager, count);
+
+    std::atomic<bool> running{true};
+    std::vector<std::thread> threads;
+    for (std::size_t shard = 0; shard < workers; ++shard) {
+        threads.emplace_back([&, shard]() {
+            while (running.load(std::memory_order_relaxed)) {
+                manager.incrementShard(shard, workers, 1);
+            }
+        });
+    }
+
+    for (auto _ : state) {
+        manager.addCounter(0);
+        if (manager.count() >= 2 * count) {
+            state.PauseTiming();
+            fill(manager, count);
+            state.ResumeTiming();
+        }
+    }
+    running.store(false, std::memory_order_relaxed);
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+    state.SetItemsProcessed(state.iterations());
+    setLabel(state);
+}
+
+void BM_GetCounters(benchmark::State &state) {
+    CounterManager manager(modeArg(state));
+    fill(manager, state.range(1));
+    Readers readers(manager, state.range(2));
+
+    for (auto _ : state) {
+        std::vector<CounterManager::Value> counters = manager.getCounters();
+        benchmark::DoNotOptimize(counters.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(1));
+    setLabel(state);
+}
+
+void BM_IncrementAll(benchmark::State &state) {
+    CounterManager manager(modeArg(state));
+    fill(manager, state.range(1));
+    Readers readers(manager, state.range(2));
+
+    for (auto _ : state) {
+        manager.incrementAll();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(1));
+    setLabel(state);
+}
+
+void BM_SetCounters(benchmark::State &state) {
+    CounterManager manager(modeArg(state));
+    const std::vector<CounterManager::Value> values(state.range(1), 1);
+    Readers readers(manager, state.range(2));
+
+    for (auto _ : state) {
+        manager.setCounters(values);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(1));
+    setLabel(state);
+}
+
+// What updateFrequency() used to do every second.
+void BM_FrequencySum(benchmark::State &state) {
+    CounterManager manager(modeArg(state));
+    fill(manager, state.range(1));
+    Readers readers(manager, state.range(2));
+
+    for (auto _ : state) {
+        const std::vector<CounterManager::Value> counters = manager.getCounters();
+        benchmark::DoNotOptimize(CounterKernels::active().sum(counters.data(), counters.size()));
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(1));
+    setLabel(state);
+}
+
+// What it does now: read the maintained total.
+void BM_FrequencyTotal(benchmark::State &state) {
+    CounterManager manager(modeArg(state));
+    fill(manager, state.range(1));
+    Readers readers(manager, state.range(2));
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(manager.total());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(1));
+    setLabel(state);
+}
+
+// Storage mode x counters (10 .. 10^7) x concurrent readers.
+void managerArgs(benchmark::internal::Benchmark *benchmark) {
+    benchmark->ArgNames({"atomic", "counters", "readers"});
+    benchmark->ArgsProduct({
+        {0, 1},
+        benchmark::CreateRange(10, 10000000, 10),
+        {0, 1, 2, 4},
+    });
+    // Waiting on a lock held by a reader does not show up as CPU time.
+    benchmark->UseRealTime();
+}
+
+} // namespace
+
+BENCHMARK(BM_AddCounter)->Apply(managerArgs);
+BENCHMARK(BM_DeleteCounter)->Apply(managerArgs);
+BENCHMARK(BM_DeleteFront)
+    ->ArgNames({"atomic", "compactor"})
+    ->ArgsProduct({{0, 1}, {0, 1}})
+    ->UseRealTime();
+BENCHMARK(BM_AddWhileIncrementing)
+    ->ArgNames({"atomic", "workers"})
+    ->ArgsProduct({{0, 1}, {1, 2, 4}})
+    ->UseRealTime();
+BENCHMARK(BM_GetCounters)->Apply(managerArgs);
+BENCHMARK(BM_IncrementAll)->Apply(managerArgs);
+BENCHMARK(BM_SetCounters)->Apply(managerArgs);
+BENCHMARK(BM_FrequencySum)->Apply(managerArgs);
+BENCHMARK(BM_FrequencyTotal)->Apply(managerArgs);
+
+BENCHMARK_MAIN();
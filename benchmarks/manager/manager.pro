@@ -0,0 +1,23 @@
+QT = core
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = managerbench
+
+INCLUDEPATH += ../..
+
+# Google Benchmark (libbenchmark-dev or a local build on the include and
+# library paths).
+LIBS += -lbenchmark -lpthread
+
+SOURCES += \
+    main.cpp \
+    ../../countermanager.cpp \
+    ../../slotindex.cpp \
+    ../../counterkernels.cpp
+
+HEADERS += \
+    ../../countermanager.h \
+    ../../counterkernels.h \
+    ../../slotindex.h
@@ -0,0 +1,357 @@
+#include "chunkedcounterstore.h"
+
+#include <QByteArray>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QVariant>
+#include <QtEndian>
+
+#include <algorithm>
+#include <limits>
+
+namespace {
+
+bool fail(QString *error, const QString &message) {
+    if (error) *error = message;
+    return false;
+}
+
+bool fail(QString *error, const QSqlQuery &query) {
+    return fail(error, query.lastError().text());
+}
+
+template <typename T, typename Source>
+QByteArray pack(const Source *data, std::size_t count) {
+    QByteArray blob(static_cast<int>(count * sizeof(T)), Qt::Uninitialized);
+    char *out = blob.data();
+    for (std::size_t i = 0; i < count; ++i) {
+        qToLittleEndian(static_cast<T>(data[i]), out + i * sizeof(T));
+    }
+    return blob;
+}
+
+template <typename T, typename Target>
+bool unpack(const QByteArray &blob, std::vector<Target> &out) {
+    if (blob.size() % sizeof(T) != 0) return false;
+    const std::size_t count = blob.size() / sizeof(T);
+    const std::size_t base = out.size();
+    out.resize(base + count);
+    for (std::size_t i = 0; i < count; ++i) {
+        out[base + i] = static_cast<Target>(qFromLittleEndian<T>(blob.constData() + i * sizeof(T)));
+    }
+    return true;
+}
+
+// Writes every chunk of `ids` and `values` into counter_chunks.
+bool insertChunks(QSqlQuery &insert, const std::vector<uint64_t> &ids, const std::vector<CounterManager::Value> &values) {
+    for (std::size_t first = 0; first < ids.size(); first += ChunkedCounterStore::kChunkSize) {
+        const std::size_t count = std::min(ChunkedCounterStore::kChunkSize, ids.size() - first);
+        insert.bindValue(0, static_cast<qlonglong>(first / ChunkedCounterStore::kChunkSize));
+        insert.bindValue(1, pack<quint64>(ids.data() + first, count));
+        insert.bindValue(2, pack<qint64>(values.data() + first, count));
+        if (!insert.exec()) return false;
+    }
+    return true;
+}
+
+} // namespace
+
+// Prepared once and reused by every save on the same connection.
+struct ChunkedCounterStore::Statements {
+    explicit Statements(const QSqlDatabase &db) : upsert(db), trim(db) {}
+
+    QSqlQuery upsert;
+    QSqlQuery trim;
+};
+
+ChunkedCounterStore::ChunkedCounterStore(const QString &connectionName)
+    : connectionName_(connectionName) {
+}
+
+ChunkedCounterStore::~ChunkedCounterStore() = default;
+
+bool ChunkedCounterStore::load(CounterManager &manager, QString *error) {
+    // Cleared below once the table is read; until then writes are refused.
+    loadFailed_ = true;
+    QSqlDatabase db = QSqlDatabase::database(connectionName_);
+    if (!db.isOpen()) {
+        return fail(error, "Database connection is not open");
+    }
+    if (!ensureSchema(db, error)) {
+        return false;
+    }
+
+    std::vector<uint64_t> ids;
+    std::vector<CounterManager::Value> values;
+    std::vector<Chunk> chunks;
+    if (!readChunks(db, chunks, ids, values, error)) {
+        return false;
+    }
+
+    manager.setCounters(values, ids);
+    saved_ = std::move(chunks);
+    synced_ = true;
+    resumeChunk_ = 0;
+    loadFailed_ = false;
+    return true;
+}
+
+bool ChunkedCounterStore::save(const CounterManager &manager, SaveStats *stats, QString *error,
+                               const Progress &progress) {
+    return write(manager, std::numeric_limits<std::size_t>::max(), stats, error, progress);
+}
+
+bool ChunkedCounterStore::checkpoint(const CounterManager &manager, int maxWrites,
+                                     SaveStats *stats, QString *error) {
+    const std::size_t maxChunks = std::max<std::size_t>(1, std::max(0, maxWrites) / kChunkSize);
+    return write(manager, maxChunks, stats, error, Progress());
+}
+
+bool ChunkedCounterStore::write(const CounterManager &manager, std::size_t maxChunks,
+                                SaveStats *stats, QString *error, const Progress &progress) {
+    if (loadFailed_) {
+        return fail(error, "Not saving over counter_chunks: it failed to load");
+    }
+    QSqlDatabase db = QSqlDatabase::database(connectionName_);
+    if (!db.isOpen()) {
+        return fail(error, "Database connection is not open");
+    }
+    if (!ensureSchema(db, error)) {
+        return false;
+    }
+
+    // Without a known image, read the table back and diff against it. A
+    // table that cannot be read is left alone: clearing it would throw
+    // away counters the manager may never have seen.
+    if (!synced_) {
+        std::vector<uint64_t> savedIds;
+        std::vector<CounterManager::Value> savedValues;
+        if (!readChunks(db, saved_, savedIds, savedValues, error)) {
+            saved_.clear();
+            return false;
+        }
+        resumeChunk_ = 0;
+    }
+
+    std::vector<uint64_t> ids;
+    std::vector<CounterManager::Value> values;
+    manager.getCountersWithIds(ids, values);
+    const std::size_t chunkCount = (ids.size() + kChunkSize - 1) / kChunkSize;
+    if (!appendOnly(ids)) {
+        maxChunks = std::numeric_limits<std::size_t>::max();
+    }
+
+    if (!db.transaction()) {
+        return fail(error, db.lastError().text());
+    }
+
+    if (!statements_) {
+        auto statements = std::make_unique<Statements>(db);
+        if (!statements->upsert.prepare("INSERT OR REPLACE INTO counter_chunks (chunk, ids, counter_values) VALUES (?, ?, ?)")
+            || !statements->trim.prepare("DELETE FROM counter_chunks WHERE chunk >= ?")) {
+            db.rollback();
+            return fail(error, db.lastError().text());
+        }
+        statements_ = std::move(statements);
+    }
+    QSqlQuery &upsert = statements_->upsert;
+    QSqlQuery &trim = statements_->trim;
+
+    SaveStats result;
+    if (saved_.size() > chunkCount) {
+        trim.bindValue(0, static_cast<qlonglong>(chunkCount));
+        if (!trim.exec()) {
+            const QString message = trim.lastError().text();
+            db.rollback();
+            synced_ = false;
+            statements_.reset();
+            return fail(error, message);
+        }
+        result.deleted = static_cast<int>(saved_.size() - chunkCount);
+        saved_.resize(chunkCount);
+    }
+
+    // Visit every chunk once, starting where the previous bounded write
+    // stopped, and rewrite those that differ from the saved copy. Never
+    // start past the present prefix, so appended chunks go out in order
+    // and the table has no gaps.
+    std::size_t prefix = 0;
+    while (prefix < saved_.size() && !saved_[prefix].ids.empty()) {
+        ++prefix;
+    }
+    const std::size_t start = std::min(resumeChunk_ < chunkCount ? resumeChunk_ : 0, prefix);
+    std::vector<std::size_t> written;
+    std::size_t stopChunk = chunkCount;
+    for (std::size_t step = 0; step < chunkCount; ++step) {
+        const std::size_t c = (start + step) % chunkCount;
+        if (progress && (step & 15) == 15) {
+            progress(static_cast<int>(step * kChunkSize), static_cast<int>(ids.size()));
+        }
+
+        const std::size_t first = c * kChunkSize;
+        const std::size_t count = std::min(kChunkSize, ids.size() - first);
+        const bool present = c < saved_.size() && !saved_[c].ids.empty();
+        if (present && saved_[c].ids.size() == count
+            && std::equal(ids.begin() + first, ids.begin() + first + count, saved_[c].ids.begin())
+            && std::equal(values.begin() + first, values.begin() + first + count, saved_[c].values.begin())) {
+            continue;
+        }
+        if (written.size() == maxChunks) {
+            stopChunk = c;
+            break;
+        }
+
+        upsert.bindValue(0, static_cast<qlonglong>(c));
+        upsert.bindValue(1, pack<quint64>(ids.data() + first, count));
+        upsert.bindValue(2, pack<qint64>(values.data() + first, count));
+        if (!upsert.exec()) {
+            const QString message = upsert.lastError().text();
+            db.rollback();
+            synced_ = false;
+            statements_.reset();
+            return fail(error, message);
+        }
+        written.push_back(c);
+        ++(present ? result.updated : result.inserted);
+        result.rows += static_cast<qint64>(count);
+    }
+
+    if (!db.commit()) {
+        db.rollback();
+        synced_ = false;
+        return fail(error, db.lastError().text());
+    }
+
+    // A bounded write may skip chunks past the end of the saved copy; pad
+    // with empty chunks, which never match, to keep the copy positional.
+    if (saved_.size() < chunkCount) {
+        saved_.resize(chunkCount);
+    }
+    for (std::size_t c : written) {
+        const std::size_t first = c * kChunkSize;
+        const std::size_t count = std::min(kChunkSize, ids.size() - first);
+        saved_[c].ids.assign(ids.begin() + first, ids.begin() + first + count);
+        saved_[c].values.assign(values.begin() + first, values.begin() + first + count);
+    }
+    resumeChunk_ = stopChunk < chunkCount ? stopChunk : 0;
+    synced_ = true;
+
+    result.complete = stopChunk == chunkCount;
+    if (progress) progress(static_cast<int>(ids.size()), static_cast<int>(ids.size()));
+    if (stats) *stats = result;
+    return true;
+}
+
+// Reads and validates the whole table. Chunks must be numbered 0..n-1 with
+// only the last one short, and ids must ascend across all of them.
+bool ChunkedCounterStore::readChunks(QSqlDatabase &db, std::vector<Chunk> &chunks, std::vector<uint64_t> &ids,
+                                     std::vector<CounterManager::Value> &values, QString *error) {
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    if (!query.exec("SELECT chunk, ids, counter_values FROM counter_chunks ORDER BY chunk")) {
+        return fail(error, query);
+    }
+
+    chunks.clear();
+    ids.clear();
+    values.clear();
+    while (query.next()) {
+        const std::size_t first = ids.size();
+        const bool inOrder = query.value(0).toULongLong() == chunks.size()
+                             && first == chunks.size() * kChunkSize;
+        if (!inOrder
+            || !unpack<quint64>(query.value(1).toByteArray(), ids)
+            || !unpack<qint64>(query.value(2).toByteArray(), values)
+            || ids.size() != values.size() || ids.size() - first > kChunkSize) {
+            return fail(error, "counter_chunks is corrupt");
+        }
+        for (std::size_t i = std::max<std::size_t>(first, 1); i < ids.size(); ++i) {
+            if (ids[i] <= ids[i - 1]) {
+                return fail(error, "counter_chunks is corrupt (ids out of order)");
+            }
+        }
+        Chunk chunk;
+        chunk.ids.assign(ids.begin() + first, ids.end());
+        chunk.values.assign(values.begin() + first, values.end());
+        chunks.push_back(std::move(chunk));
+    }
+    if (query.lastError().isValid()) {
+        return fail(error, query);
+    }
+    return true;
+}
+
+// True if the current ids only extend what the table holds, so any subset
+// of chunk rewrites leaves ascending ids and loses no saved counter.
+bool ChunkedCounterStore::appendOnly(const std::vector<uint64_t> &ids) const {
+    for (std::size_t c = 0; c < saved_.size(); ++c) {
+        const Chunk &chunk = saved_[c];
+        const std::size_t first = c * kChunkSize;
+        if (first + chunk.ids.size() > ids.size()
+            || !std::equal(chunk.ids.begin(), chunk.ids.end(), ids.begin() + first)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void ChunkedCounterStore::invalidate() {
+    synced_ = false;
+    loadFailed_ = false;
+    resumeChunk_ = 0;
+    saved_.clear();
+}
+
+void ChunkedCounterStore::releaseConnection() {
+    statements_.reset();
+}
+
+bool ChunkedCounterStore::ensureSchema(QSqlDatabase &db, QString *error) {
+    const QStringList tables = db.tables();
+    if (tables.contains("counter_chunks")) {
+        return true;
+    }
+
+    QSqlQuery query(db);
+    if (!db.transaction()) {
+        return fail(error, db.lastError().text());
+    }
+    if (!query.exec("CREATE TABLE counter_chunks (chunk INTEGER PRIMARY KEY, ids BLOB, counter_values BLOB)")) {
+        db.rollback();
+        return fail(error, query);
+    }
+
+    if (tables.contains("counters")) {
+        // Per-row schema, with or without an id column: rowid is the id
+        // either way.
+        std::vector<uint64_t> ids;
+        std::vector<CounterManager::Value> values;
+        query.setForwardOnly(true);
+        if (!query.exec("SELECT rowid, value FROM counters ORDER BY rowid")) {
+            db.rollback();
+            return fail(error, query);
+        }
+        while (query.next()) {
+            ids.push_back(query.value(0).toULongLong());
+            values.push_back(query.value(1).toLongLong());
+        }
+
+        QSqlQuery insert(db);
+        if (!insert.prepare("INSERT INTO counter_chunks (chunk, ids, counter_values) VALUES (?, ?, ?)")
+            || !insertChunks(insert, ids, values)) {
+            db.rollback();
+            return fail(error, insert);
+        }
+        // Kept under another name rather than dropped: the per-row store
+        // refuses a chunked database, and the old rows stay recoverable.
+        if (!query.exec("ALTER TABLE counters RENAME TO counters_premigration")) {
+            db.rollback();
+            return fail(error, query);
+        }
+    }
+
+    if (!db.commit()) {
+        return fail(error, db.lastError().text());
+    }
+    return true;
+}
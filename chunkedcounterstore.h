@@ -0,0 +1,73 @@
+#ifndef CHUNKEDCOUNTERSTORE_H
+#define CHUNKEDCOUNTERSTORE_H
+
+#include "counterbackend.h"
+
+#include <QString>
+#include <QSqlDatabase>
+
+#include <vector>
+#include <cstdint>
+#include <memory>
+
+// Persists a CounterManager in the `counter_chunks` table of a SQLite
+// connection. Counters are grouped by position into chunks of kChunkSize;
+// each chunk is one row holding the packed ids and values as BLOBs, so a
+// million counters are a few hundred rows. A save rewrites only the chunks
+// whose contents differ from what the table holds.
+//
+// Opening a database that still has the per-row `counters` table migrates
+// it into chunks and drops it.
+class ChunkedCounterStore : public CounterBackend {
+     Q_DISABLE_COPY(ChunkedCounterStore)
+public:
+    static constexpr std::size_t kChunkSize = 4096;
+
+    // Like CounterStore, keeps prepared statements until destroyed.
+    explicit ChunkedCounterStore(const QString &connectionName = QLatin1String(QSqlDatabase::defaultConnection));
+    ~ChunkedCounterStore() override;
+
+    bool load(CounterManager &manager, QString *error = nullptr) override;
+    bool save(const CounterManager &manager, SaveStats *stats = nullptr, QString *error = nullptr,
+              const Progress &progress = Progress()) override;
+    // Rewrites at most maxWrites / kChunkSize chunks (at least one),
+    // continuing after the last chunk written by the previous call. Chunks
+    // are positional, so after a delete every chunk behind it shifts; then
+    // all differing chunks are rewritten in one transaction, since a
+    // partial rewrite would store duplicate or missing ids.
+    bool checkpoint(const CounterManager &manager, int maxWrites,
+                    SaveStats *stats = nullptr, QString *error = nullptr) override;
+    void invalidate() override;
+    void releaseConnection() override;
+
+private:
+    // Saved contents of one chunk row.
+    struct Chunk {
+        std::vector<uint64_t> ids;
+        std::vector<CounterManager::Value> values;
+    };
+
+    struct Statements;
+
+    bool ensureSchema(QSqlDatabase &db, QString *error);
+    bool readChunks(QSqlDatabase &db, std::vector<Chunk> &chunks, std::vector<uint64_t> &ids,
+                    std::vector<CounterManager::Value> &values, QString *error);
+    bool appendOnly(const std::vector<uint64_t> &ids) const;
+    bool write(const CounterManager &manager, std::size_t maxChunks,
+               SaveStats *stats, QString *error, const Progress &progress);
+
+    QString connectionName_;
+    std::unique_ptr<Statements> statements_;
+
+    // Table contents after the last successful load/save, by chunk index.
+    // Present chunks always form a prefix; missing ones are empty.
+    bool synced_ = false;
+    std::vector<Chunk> saved_;
+    // Chunk where the last bounded write stopped; 0 after a complete write.
+    std::size_t resumeChunk_ = 0;
+    // Set by a failed load; saves are refused until a load succeeds or
+    // invalidate() is called.
+    bool loadFailed_ = false;
+};
+
+#endif // CHUNKEDCOUNTERSTORE_H
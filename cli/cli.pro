@@ -0,0 +1,11 @@
+QT = core
+
+CONFIG += console
+CONFIG -= app_bundle
+
+TARGET = tableincr-cli
+
+include(../engine/engine.pri)
+
+SOURCES += \
+    main.cpp
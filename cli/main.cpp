@@ -0,0 +1,147 @@
+#include "counterservice.h"
+#include "engineoptions.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QTimer>
+
+#include <algorithm>
+#include <csignal>
+#include <cstdio>
+#include <numeric>
+#include <vector>
+
+// Headless driver: runs the counter engine and persistence without a
+// display and prints rates to stdout.
+
+namespace {
+
+volatile std::sig_atomic_t g_interrupted = 0;
+
+void onSignal(int) {
+    g_interrupted = 1;
+}
+
+uint64_t totalIncrements(const CounterEngine &engine) {
+    const std::vector<uint64_t> shards = engine.shardIncrements();
+    return std::accumulate(shards.begin(), shards.end(), uint64_t(0));
+}
+
+void printRates(CounterService &service, double elapsedSec) {
+    const RateEstimator::Rates total = service.rates().totalRates();
+    const RateEstimator::Rates perCounter = service.rates().tickRates();
+    const TickScheduler::Stats ticks = service.engine().takeTickStats();
+    std::printf("%8.1f s  %d counters  total %.0f Hz (10 s %.0f, 60 s %.0f, EWMA %.0f)  "
+                "per counter %.1f Hz  late avg %.1f us max %.1f us  missed %llu\n",
+                elapsedSec, service.manager().count(), total.window1s, total.window10s,
+                total.window60s, total.ewma, perCounter.window1s, ticks.meanLatenessUs,
+                ticks.maxLatenessUs, static_cast<unsigned long long>(ticks.missed));
+    std::fflush(stdout);
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Runs the counter engine without a GUI.");
+    parser.addHelpOption();
+    EngineOptions::add(parser);
+    QCommandLineOption countersOption("counters",
+                                      "Counters to create when the store has none.",
+                                      "count", "0");
+    parser.addOption(countersOption);
+    QCommandLineOption durationOption("duration",
+                                      "Stop after N seconds (0 runs until interrupted).",
+                                      "seconds", "0");
+    parser.addOption(durationOption);
+    QCommandLineOption reportOption("report",
+                                    "Print rates every N seconds (0 disables).",
+                                    "seconds", "1");
+    parser.addOption(reportOption);
+    QCommandLineOption saveOnExitOption("save-on-exit",
+                                        "Save the counters before exiting.");
+    parser.addOption(saveOnExitOption);
+    parser.process(app);
+
+    const EngineConfig config = EngineOptions::parse(parser);
+    const int initialCounters = std::max(0, parser.value(countersOption).toInt());
+    const double durationSec = std::max(0.0, parser.value(durationOption).toDouble());
+    const double reportSec = std::max(0.0, parser.value(reportOption).toDouble());
+    const bool saveOnExit = parser.isSet(saveOnExitOption);
+
+    CounterService service(config);
+    QElapsedTimer runTime;
+
+    QObject::connect(&service, &CounterService::loaded, &app, [&](bool ok, const QString &error) {
+        if (!ok) {
+            // Seeding or saving now would overwrite counters we could not read.
+            std::fprintf(stderr, "Failed to load counters: %s\n", qPrintable(error));
+            QCoreApplication::exit(1);
+            return;
+        }
+        if (service.manager().count() == 0 && initialCounters > 0) {
+            service.manager().setCounters(std::vector<CounterManager::Value>(initialCounters, 0));
+            // The journal does not record setCounters(); snapshot it.
+            service.compactJournal();
+        }
+        std::printf("Running %d counters on %zu threads\n", service.manager().count(),
+                    service.engine().threadCount());
+        std::fflush(stdout);
+    });
+
+    bool stopping = false;
+    auto finish = [&]() {
+        if (stopping) return;
+        stopping = true;
+        if (!saveOnExit) {
+            app.quit();
+            return;
+        }
+        QObject::connect(&service, &CounterService::saved, &app,
+                         [&](bool ok, const QString &error, int inserted, int updated, int deleted) {
+            if (ok) {
+                std::printf("Saved: %d inserted, %d updated, %d deleted\n", inserted, updated, deleted);
+            } else {
+                std::fprintf(stderr, "Failed to save counters: %s\n", qPrintable(error));
+            }
+            app.quit();
+        });
+        service.save();
+    };
+
+    std::signal(SIGINT, onSignal);
+    std::signal(SIGTERM, onSignal);
+    // Signal handlers may only set a flag; the event loop picks it up.
+    QTimer interruptTimer;
+    QObject::connect(&interruptTimer, &QTimer::timeout, &app, [&]() {
+        if (g_interrupted) finish();
+    });
+    interruptTimer.start(100);
+
+    QTimer reportTimer;
+    QObject::connect(&reportTimer, &QTimer::timeout, &app, [&]() {
+        printRates(service, runTime.elapsed() / 1000.0);
+    });
+    if (reportSec > 0) {
+        reportTimer.start(static_cast<int>(reportSec * 1000));
+    }
+    if (durationSec > 0) {
+        QTimer::singleShot(static_cast<int>(durationSec * 1000), &app, finish);
+    }
+
+    runTime.start();
+    service.start();
+    const int result = QCoreApplication::exec();
+    service.engine().stop();
+
+    const double elapsedSec = runTime.elapsed() / 1000.0;
+    const uint64_t increments = totalIncrements(service.engine());
+    std::printf("Ran %.1f s: %llu increments, %.0f increments/s\n", elapsedSec,
+                static_cast<unsigned long long>(increments),
+                elapsedSec > 0 ? increments / elapsedSec : 0.0);
+    service.stop();
+    return result;
+}
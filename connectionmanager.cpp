@@ -0,0 +1,75 @@
+#include "connectionmanager.h"
+
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QThread>
+
+ConnectionManager::ConnectionManager(const QString &databasePath, const SqliteProfile &profile)
+    : databasePath_(databasePath),
+      profile_(profile) {
+}
+
+ConnectionManager::~ConnectionManager() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto &entry : connections_) {
+        QSqlDatabase::removeDatabase(entry.second);
+    }
+}
+
+QString ConnectionManager::acquire(QString *error) {
+    QThread *thread = QThread::currentThread();
+    QString name;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = connections_.find(thread);
+        if (it == connections_.end()) {
+            name = nameFor(thread);
+            QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", name);
+            db.setDatabaseName(databasePath_);
+            connections_.emplace(thread, name);
+        } else {
+            name = it->second;
+        }
+    }
+
+    // Only the owning thread touches the connection itself.
+    QSqlDatabase db = QSqlDatabase::database(name, false);
+    if (db.isOpen()) return name;
+
+    if (!db.open()) {
+        if (error) *error = "Failed to open database: " + db.lastError().text();
+        return QString();
+    }
+    opens_.fetch_add(1, std::memory_order_relaxed);
+
+    QString profileError;
+    if (!profile_.apply(db, &profileError)) {
+        db.close();
+        if (error) *error = "Failed to apply SQLite profile " + profile_.name + ": " + profileError;
+        return QString();
+    }
+    return name;
+}
+
+void ConnectionManager::reconnect() {
+    QString name;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = connections_.find(QThread::currentThread());
+        if (it == connections_.end()) return;
+        name = it->second;
+        connections_.erase(it);
+    }
+
+    {
+        QSqlDatabase db = QSqlDatabase::database(name, false);
+        db.close();
+    }
+    QSqlDatabase::removeDatabase(name);
+}
+
+QString ConnectionManager::nameFor(QThread *thread) const {
+    return QString("counters-%1-%2")
+        .arg(reinterpret_cast<quintptr>(this), 0, 16)
+        .arg(reinterpret_cast<quintptr>(thread), 0, 16);
+}
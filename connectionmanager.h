@@ -0,0 +1,50 @@
+#ifndef CONNECTIONMANAGER_H
+#define CONNECTIONMANAGER_H
+
+#include "sqliteprofile.h"
+
+#include <QString>
+
+#include <map>
+#include <mutex>
+#include <atomic>
+
+class QThread;
+
+// Hands out one long-lived SQLite connection per thread for a database
+// file. A connection is opened (and tuned with the profile) on the first
+// acquire() from a thread and then stays open, so loads, saves and
+// checkpoints never pay for open/close. After an error, reconnect() closes
+// the calling thread's connection and the next acquire() opens a fresh one
+// under the same name, so stores keyed by the name keep working.
+class ConnectionManager {
+     Q_DISABLE_COPY(ConnectionManager)
+public:
+    ConnectionManager(const QString &databasePath, const SqliteProfile &profile);
+    // Removes all connections. Each thread should be done with its
+    // connection (and its queries) by then.
+    ~ConnectionManager();
+
+    // Name of the calling thread's open connection, or an empty string
+    // with *error set if it cannot be opened.
+    QString acquire(QString *error = nullptr);
+
+    // Closes the calling thread's connection; the next acquire() reopens
+    // it. Queries on it must be destroyed first.
+    void reconnect();
+
+    // Physical opens so far, reconnects included.
+    int openCount() const { return opens_.load(std::memory_order_relaxed); }
+
+private:
+    QString nameFor(QThread *thread) const;
+
+    const QString databasePath_;
+    const SqliteProfile profile_;
+
+    std::mutex mutex_;
+    std::map<QThread *, QString> connections_;
+    std::atomic<int> opens_{0};
+};
+
+#endif // CONNECTIONMANAGER_H
@@ -0,0 +1,50 @@
+#ifndef COUNTERBACKEND_H
+#define COUNTERBACKEND_H
+
+#include "countermanager.h"
+
+#include <QString>
+
+#include <functional>
+
+// Persistence for a CounterManager. Backends remember what they hold after
+// each load/save so that a save only writes what changed since.
+class CounterBackend {
+public:
+    struct SaveStats {
+        int inserted = 0;
+        int updated = 0;
+        int deleted = 0;
+        // Counter rows written, what autosave checkpoints are budgeted in.
+        qint64 rows = 0;
+        // False if a checkpoint hit its write limit before all differences
+        // were written.
+        bool complete = true;
+    };
+
+    // Called every few thousand rows with (rows processed, rows total).
+    using Progress = std::function<void(int, int)>;
+
+    virtual ~CounterBackend() = default;
+
+    // Replaces the manager's counters with the stored ones.
+    virtual bool load(CounterManager &manager, QString *error = nullptr) = 0;
+
+    // Writes the difference between the manager and the stored counters.
+    virtual bool save(const CounterManager &manager, SaveStats *stats = nullptr, QString *error = nullptr,
+                      const Progress &progress = Progress()) = 0;
+
+    // Like save() but aims for at most maxWrites counter writes; backends
+    // whose writes are cheap may ignore the limit.
+    virtual bool checkpoint(const CounterManager &manager, int maxWrites,
+                            SaveStats *stats = nullptr, QString *error = nullptr) = 0;
+
+    // Forget what the backend holds; the next save rewrites everything.
+    virtual void invalidate() = 0;
+
+    // Drops anything kept on the current connection, such as prepared
+    // statements, so the connection can be closed and reopened.
+    virtual void releaseConnection() {}
+};
+
+#endif // COUNTERBACKEND_H
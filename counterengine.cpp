@@ -0,0 +1,157 @@
+#include "counterengine.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+CounterEngine::CounterEngine(CounterManager &manager, const EngineConfig &config)
+    : manager_(manager),
+      shardCount_(std::max(1, config.shardCount)),
+      threadCount_(std::min<std::size_t>(std::max(1, config.threadCount), shardCount_)),
+      pinCore_(config.pinCore),
+      shardStats_(new ShardStats[shardCount_]),
+      freeRunning_(config.freeRunning) {
+    schedulers_.reserve(threadCount_);
+    for (std::size_t worker = 0; worker < threadCount_; ++worker) {
+        schedulers_.push_back(std::make_unique<TickScheduler>(
+            config.tickRateHz, config.catchUp, config.waitMode));
+    }
+}
+
+CounterEngine::~CounterEngine() {
+    stop();
+}
+
+void CounterEngine::start() {
+    if (running_.exchange(true)) return;
+
+    workers_.reserve(threadCount_);
+    for (std::size_t worker = 0; worker < threadCount_; ++worker) {
+        workers_.emplace_back(&CounterEngine::run, this, worker);
+    }
+    compactor_ = std::thread(&CounterEngine::compact, this);
+}
+
+void CounterEngine::stop() {
+    running_.store(false);
+    for (auto &scheduler : schedulers_) {
+        scheduler->interrupt();
+    }
+
+    for (std::thread &worker : workers_) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+    workers_.clear();
+    if (compactor_.joinable()) {
+        compactor_.join();
+    }
+}
+
+std::vector<uint64_t> CounterEngine::shardIncrements() const {
+    std::vector<uint64_t> increments(shardCount_);
+    for (std::size_t shard = 0; shard < shardCount_; ++shard) {
+        increments[shard] = shardStats_[shard].increments.load(std::memory_order_relaxed);
+    }
+    return increments;
+}
+
+void CounterEngine::setFreeRunning(bool freeRunning) {
+    freeRunning_.store(freeRunning, std::memory_order_relaxed);
+}
+
+void CounterEngine::setPaused(bool paused) {
+    paused_.store(paused, std::memory_order_relaxed);
+    if (!paused) return;
+    for (auto &scheduler : schedulers_) {
+        scheduler->interrupt();
+    }
+}
+
+void CounterEngine::setTickRate(double rateHz) {
+    for (auto &scheduler : schedulers_) {
+        scheduler->setRate(rateHz);
+    }
+}
+
+double CounterEngine::tickRate() const {
+    return schedulers_.front()->rate();
+}
+
+TickScheduler::Stats CounterEngine::takeTickStats() {
+    TickScheduler::Stats stats;
+    for (auto &scheduler : schedulers_) {
+        stats = TickScheduler::merge(stats, scheduler->takeStats());
+    }
+    return stats;
+}
+
+void CounterEngine::run(std::size_t worker) {
+    pinToCore(worker);
+
+    TickScheduler &scheduler = *schedulers_[worker];
+    // Pacing restarts from a fresh deadline grid whenever the worker comes
+    // back from a pause or from free-running, so no backlog is replayed.
+    bool paced = false;
+    while (running_.load(std::memory_order_relaxed)) {
+        if (paused_.load(std::memory_order_relaxed)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            paced = false;
+            continue;
+        }
+
+        if (freeRunning_.load(std::memory_order_relaxed)) {
+            paced = false;
+        } else {
+            if (!paced) {
+                scheduler.restart();
+                paced = true;
+            }
+            if (!scheduler.waitNextTick()) continue;
+        }
+        // A pause or stop may have come in during the wait.
+        if (paused_.load(std::memory_order_relaxed) || !running_.load(std::memory_order_relaxed)) {
+            continue;
+        }
+
+        for (std::size_t shard = worker; shard < shardCount_; shard += threadCount_) {
+            std::size_t done = manager_.incrementShard(shard, shardCount_);
+            shardStats_[shard].increments.fetch_add(done, std::memory_order_relaxed);
+        }
+    }
+}
+
+// Each step holds the manager lock only for a bounded number of slots, so
+// increments keep running between steps.
+void CounterEngine::compact() {
+    while (running_.load(std::memory_order_relaxed)) {
+        if (manager_.compactStep()) {
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+    }
+}
+
+void CounterEngine::pinToCore(std::size_t worker) const {
+    if (pinCore_ < 0) return;
+#ifdef __linux__
+    const unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    const unsigned core = (pinCore_ + worker) % cores;
+    CPU_SET(core, &cpus);
+    const int result = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    if (result != 0) {
+        qWarning("Cannot pin worker %zu to core %u: %s", worker, core, std::strerror(result));
+    }
+#else
+    Q_UNUSED(worker);
+#endif
+}
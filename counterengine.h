@@ -0,0 +1,76 @@
+#ifndef COUNTERENGINE_H
+#define COUNTERENGINE_H
+
+#include "countermanager.h"
+#include "engineconfig.h"
+#include "tickscheduler.h"
+
+#include <QtGlobal>
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+// Drives a CounterManager from a pool of worker threads. The counters are
+// split into shardCount cache-line aligned shards and every worker owns a
+// fixed subset of them (shard i belongs to worker i % threadCount). A
+// separate thread compacts the tombstones deletes leave behind.
+class CounterEngine {
+     Q_DISABLE_COPY(CounterEngine)
+public:
+    CounterEngine(CounterManager &manager, const EngineConfig &config);
+    ~CounterEngine();
+
+    void start();
+    void stop();
+
+    std::size_t shardCount() const { return shardCount_; }
+    std::size_t threadCount() const { return threadCount_; }
+
+    // Cumulative number of counter increments done by each shard.
+    std::vector<uint64_t> shardIncrements() const;
+
+    // Free-running workers skip the tick scheduler entirely; used to probe
+    // raw increment throughput. Can be toggled while running.
+    void setFreeRunning(bool freeRunning);
+    bool isFreeRunning() const { return freeRunning_.load(std::memory_order_relaxed); }
+
+    // Paused workers stop incrementing until resumed.
+    void setPaused(bool paused);
+    bool isPaused() const { return paused_.load(std::memory_order_relaxed); }
+
+    void setTickRate(double rateHz);
+    double tickRate() const;
+
+    // Tick statistics of all workers since the previous call.
+    TickScheduler::Stats takeTickStats();
+
+private:
+    struct alignas(CounterManager::kCacheLineSize) ShardStats {
+        std::atomic<uint64_t> increments{0};
+    };
+
+    void run(std::size_t worker);
+    void compact();
+    void pinToCore(std::size_t worker) const;
+
+    CounterManager &manager_;
+    const std::size_t shardCount_;
+    const std::size_t threadCount_;
+    const int pinCore_;
+
+    std::unique_ptr<ShardStats[]> shardStats_;
+    // One scheduler per worker, created up front so stats and rate changes
+    // can be applied whether or not the engine is running.
+    std::vector<std::unique_ptr<TickScheduler>> schedulers_;
+    std::vector<std::thread> workers_;
+    std::thread compactor_;
+    std::atomic<bool> running_{false};
+    std::atomic<bool> freeRunning_{false};
+    std::atomic<bool> paused_{false};
+};
+
+#endif // COUNTERENGINE_H
@@ -0,0 +1,389 @@
+#include "counterjournal.h"
+
+#include <QDir>
+#include <QSaveFile>
+#include <QtEndian>
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr quint32 kSnapshotMagic = 0x4e534a43; // "CJSN"
+constexpr quint32 kSnapshotVersion = 2;
+constexpr int kSnapshotHeaderSize = 4 + 4 + 8 + 8 + 8;
+constexpr int kPairSize = 8 + 8;
+
+// type, sequence, id, value, checksum
+constexpr int kRecordPayloadSize = 1 + 8 + 8 + 8;
+constexpr int kRecordSize = kRecordPayloadSize + 4;
+
+// Copies taken by compact() to find one no edit raced with.
+constexpr int kCutAttempts = 4;
+
+// Commit early once this much is buffered instead of waiting for the timer.
+constexpr int kEagerCommitBytes = 64 * 1024;
+
+const char kSnapshotName[] = "snapshot";
+const char kSegmentPrefix[] = "journal.";
+
+// FNV-1a; only has to catch torn or partially written records.
+quint32 checksum(const char *data, qsizetype size) {
+    quint32 hash = 2166136261u;
+    for (qsizetype i = 0; i < size; ++i) {
+        hash ^= static_cast<quint8>(data[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+template <typename T>
+void put(char *&out, T value) {
+    qToLittleEndian(value, out);
+    out += sizeof(T);
+}
+
+template <typename T>
+T get(const char *&in) {
+    T value = qFromLittleEndian<T>(in);
+    in += sizeof(T);
+    return value;
+}
+
+bool fail(QString *error, const QString &message) {
+    if (error) *error = message;
+    return false;
+}
+
+} // namespace
+
+CounterJournal::CounterJournal(const QString &directory, int commitIntervalMs)
+    : directory_(directory),
+      commitIntervalMs_(std::max(1, commitIntervalMs)) {
+    QDir().mkpath(directory_);
+    const std::vector<quint64> segments = segmentIndexes();
+    segmentIndex_ = segments.empty() ? 0 : segments.back() + 1;
+}
+
+CounterJournal::~CounterJournal() {
+    close();
+}
+
+bool CounterJournal::recover(std::vector<uint64_t> &ids, std::vector<CounterManager::Value> &values, QString *error) {
+    if (error) error->clear();
+
+    QFile snapshot(QDir(directory_).filePath(kSnapshotName));
+    if (!snapshot.exists()) return false;
+    if (!snapshot.open(QIODevice::ReadOnly)) {
+        return fail(error, "Cannot read journal snapshot: " + snapshot.errorString());
+    }
+    const QByteArray data = snapshot.readAll();
+    if (data.size() < kSnapshotHeaderSize + 4
+        || checksum(data.constData(), data.size() - 4)
+               != qFromLittleEndian<quint32>(data.constData() + data.size() - 4)) {
+        return fail(error, "Journal snapshot is corrupt");
+    }
+
+    const char *in = data.constData();
+    const quint32 magic = get<quint32>(in);
+    const quint32 version = get<quint32>(in);
+    const quint64 firstSegment = get<quint64>(in);
+    const quint64 cut = get<quint64>(in);
+    const quint64 count = get<quint64>(in);
+    if (magic != kSnapshotMagic || version != kSnapshotVersion
+        || data.size() != static_cast<qsizetype>(kSnapshotHeaderSize + count * kPairSize + 4)) {
+        return fail(error, "Journal snapshot has an unknown format");
+    }
+
+    std::map<uint64_t, CounterManager::Value> state;
+    for (quint64 i = 0; i < count; ++i) {
+        const quint64 id = get<quint64>(in);
+        state[id] = get<qint64>(in);
+    }
+
+    quint64 sequence = cut;
+    for (quint64 index : segmentIndexes()) {
+        if (index < firstSegment) continue;
+
+        QFile segment(segmentPath(index));
+        if (!segment.open(QIODevice::ReadOnly)) {
+            return fail(error, "Cannot read journal segment: " + segment.errorString());
+        }
+        const QByteArray records = segment.readAll();
+        bool torn = false;
+        for (qsizetype offset = 0; offset + kRecordSize <= records.size(); offset += kRecordSize) {
+            const char *record = records.constData() + offset;
+            if (checksum(record, kRecordPayloadSize)
+                != qFromLittleEndian<quint32>(record + kRecordPayloadSize)) {
+                torn = true;
+                break;
+            }
+            const quint8 type = static_cast<quint8>(*record++);
+            const quint64 recordSequence = get<quint64>(record);
+            const quint64 id = get<quint64>(record);
+            const CounterManager::Value value = get<qint64>(record);
+            sequence = std::max(sequence, recordSequence);
+            // Already in the snapshot, possibly with increments since.
+            if (recordSequence <= cut) continue;
+            switch (type) {
+            case Add:
+                // Ids are never reused: if it is there, the snapshot has it.
+                state.emplace(id, value);
+                break;
+            case Delete:
+                state.erase(id);
+                break;
+            case Set: {
+                auto it = state.find(id);
+                if (it != state.end()) it->second = value;
+                break;
+            }
+            default:
+                torn = true;
+                break;
+            }
+            if (torn) break;
+        }
+        // A torn record can only be the tail of the last segment written
+        // before a crash; nothing after it was ever committed.
+        if (torn || records.size() % kRecordSize != 0) break;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(pendingMutex_);
+        sequence_ = sequence;
+    }
+
+    ids.clear();
+    values.clear();
+    ids.reserve(state.size());
+    values.reserve(state.size());
+    for (const auto &entry : state) {
+        ids.push_back(entry.first);
+        values.push_back(entry.second);
+    }
+    return true;
+}
+
+bool CounterJournal::open(QString *error) {
+    {
+        std::lock_guard<std::mutex> lock(segmentMutex_);
+        if (segment_.isOpen()) return true;
+        if (!openSegmentLocked(error)) return false;
+        opened_ = true;
+    }
+
+    std::lock_guard<std::mutex> lock(pendingMutex_);
+    failed_ = false;
+    failure_.clear();
+    stopping_ = false;
+    flusher_ = std::thread(&CounterJournal::flushLoop, this);
+    return true;
+}
+
+void CounterJournal::close() {
+    {
+        std::lock_guard<std::mutex> lock(pendingMutex_);
+        stopping_ = true;
+    }
+    pendingCondition_.notify_one();
+    if (flusher_.joinable()) {
+        flusher_.join();
+    }
+
+    std::lock_guard<std::mutex> lock(segmentMutex_);
+    segment_.close();
+    opened_ = false;
+}
+
+bool CounterJournal::compact(const CounterManager &manager, QString *error) {
+    // Rotate first: everything committed to older segments happened before
+    // the copy below, so the snapshot covers it. A segment that failed to
+    // open is retried here.
+    quint64 firstSegment = 0;
+    {
+        std::lock_guard<std::mutex> lock(segmentMutex_);
+        if (opened_) {
+            if (segment_.isOpen()) {
+                segment_.close();
+                ++segmentIndex_;
+            }
+            if (!openSegmentLocked(error)) return false;
+        }
+        firstSegment = segmentIndex_;
+    }
+
+    // The copy covers whatever a failed commit lost, so accept edits again
+    // from here on; a failed snapshot latches the failure back.
+    QString failure;
+    {
+        std::lock_guard<std::mutex> lock(pendingMutex_);
+        failure = failure_;
+        failed_ = false;
+        failure_.clear();
+    }
+
+    // Edits are reported under the manager lock, which the copy holds too,
+    // so if no record was appended around it, the copy includes exactly the
+    // records up to `cut`. Under a stream of edits we settle for the cut
+    // before the copy: a Set racing it is then replayed over a snapshot
+    // that may already include later increments of that counter.
+    const auto lastSequence = [this]() {
+        std::lock_guard<std::mutex> lock(pendingMutex_);
+        return sequence_;
+    };
+    std::vector<uint64_t> ids;
+    std::vector<CounterManager::Value> values;
+    quint64 cut = 0;
+    for (int attempt = 0; attempt < kCutAttempts; ++attempt) {
+        cut = lastSequence();
+        manager.getCountersWithIds(ids, values);
+        if (lastSequence() == cut) break;
+    }
+
+    QByteArray data(kSnapshotHeaderSize + static_cast<qsizetype>(ids.size()) * kPairSize + 4, Qt::Uninitialized);
+    char *out = data.data();
+    put<quint32>(out, kSnapshotMagic);
+    put<quint32>(out, kSnapshotVersion);
+    put<quint64>(out, firstSegment);
+    put<quint64>(out, cut);
+    put<quint64>(out, ids.size());
+    for (std::size_t i = 0; i < ids.size(); ++i) {
+        put<quint64>(out, ids[i]);
+        put<qint64>(out, values[i]);
+    }
+    put<quint32>(out, checksum(data.constData(), data.size() - 4));
+
+    // QSaveFile writes to a temporary file and renames it into place, so a
+    // crash leaves either the old or the new snapshot.
+    QSaveFile snapshot(QDir(directory_).filePath(kSnapshotName));
+    if (!snapshot.open(QIODevice::WriteOnly) || snapshot.write(data) != data.size() || !snapshot.commit()) {
+        const QString message = "Cannot write journal snapshot: " + snapshot.errorString();
+        if (!failure.isEmpty()) latch(failure);
+        return fail(error, message);
+    }
+
+    for (quint64 index : segmentIndexes()) {
+        if (index < firstSegment) {
+            QFile::remove(segmentPath(index));
+        }
+    }
+    journalBytes_.store(0, std::memory_order_relaxed);
+    return true;
+}
+
+bool CounterJournal::failed(QString *error) const {
+    std::lock_guard<std::mutex> lock(pendingMutex_);
+    if (failed_ && error) *error = failure_;
+    return failed_;
+}
+
+void CounterJournal::counterAdded(uint64_t id, CounterManager::Value value) {
+    append(Add, id, value);
+}
+
+void CounterJournal::counterDeleted(uint64_t id) {
+    append(Delete, id, 0);
+}
+
+void CounterJournal::counterSet(uint64_t id, CounterManager::Value value) {
+    append(Set, id, value);
+}
+
+void CounterJournal::append(RecordType type, uint64_t id, CounterManager::Value value) {
+    bool eager = false;
+    {
+        std::lock_guard<std::mutex> lock(pendingMutex_);
+        // Records after a hole would replay as if nothing was lost.
+        if (failed_) return;
+
+        char record[kRecordSize];
+        char *out = record;
+        *out++ = static_cast<char>(type);
+        put<quint64>(out, ++sequence_);
+        put<quint64>(out, id);
+        put<qint64>(out, value);
+        put<quint32>(out, checksum(record, kRecordPayloadSize));
+        pending_.append(record, kRecordSize);
+        eager = pending_.size() >= kEagerCommitBytes;
+    }
+    if (eager) {
+        pendingCondition_.notify_one();
+    }
+}
+
+void CounterJournal::flushLoop() {
+    for (;;) {
+        QByteArray batch;
+        bool stop = false;
+        {
+            std::unique_lock<std::mutex> lock(pendingMutex_);
+            pendingCondition_.wait_for(lock, std::chrono::milliseconds(commitIntervalMs_), [this]() {
+                return stopping_ || pending_.size() >= kEagerCommitBytes;
+            });
+            batch.swap(pending_);
+            stop = stopping_;
+        }
+
+        QString error;
+        if (!batch.isEmpty() && !commitBatch(batch, &error)) {
+            latch(error);
+        }
+        if (stop) return;
+    }
+}
+
+// One write and one fsync for the whole batch: the group commit.
+bool CounterJournal::commitBatch(const QByteArray &batch, QString *error) {
+    std::lock_guard<std::mutex> lock(segmentMutex_);
+    if (!segment_.isOpen()) {
+        return fail(error, "Journal segment is not open");
+    }
+    if (segment_.write(batch) != batch.size() || !segment_.flush()) {
+        return fail(error, "Cannot write journal segment: " + segment_.errorString());
+    }
+#ifdef Q_OS_UNIX
+    if (::fsync(segment_.handle()) != 0) {
+        return fail(error, "fsync failed on " + segment_.fileName());
+    }
+#endif
+    journalBytes_.fetch_add(batch.size(), std::memory_order_relaxed);
+    return true;
+}
+
+// Keeps the first failure; later ones follow from it.
+void CounterJournal::latch(const QString &error) {
+    std::lock_guard<std::mutex> lock(pendingMutex_);
+    if (failed_) return;
+    failed_ = true;
+    failure_ = error;
+}
+
+bool CounterJournal::openSegmentLocked(QString *error) {
+    segment_.setFileName(segmentPath(segmentIndex_));
+    if (!segment_.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        return fail(error, "Cannot open journal segment: " + segment_.errorString());
+    }
+    return true;
+}
+
+QString CounterJournal::segmentPath(quint64 index) const {
+    return QDir(directory_).filePath(kSegmentPrefix + QString::number(index));
+}
+
+std::vector<quint64> CounterJournal::segmentIndexes() const {
+    std::vector<quint64> indexes;
+    const QStringList names = QDir(directory_).entryList({QString(kSegmentPrefix) + "*"}, QDir::Files);
+    for (const QString &name : names) {
+        bool ok = false;
+        const quint64 index = name.mid(static_cast<int>(sizeof(kSegmentPrefix)) - 1).toULongLong(&ok);
+        if (ok) indexes.push_back(index);
+    }
+    std::sort(indexes.begin(), indexes.end());
+    return indexes;
+}
@@ -0,0 +1,95 @@
+#ifndef COUNTERJOURNAL_H
+#define COUNTERJOURNAL_H
+
+#include "countermanager.h"
+
+#include <QString>
+#include <QByteArray>
+#include <QFile>
+
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+
+// Append-only binary journal of single-counter edits (add/delete/set) plus
+// compact snapshots, kept in one directory:
+//
+//   snapshot      all (id, value) pairs, the first segment to replay and
+//                 the sequence number of the last record it includes
+//   journal.<n>   fixed-size checksummed records, one file per segment
+//
+// Edits are buffered in memory and group-committed by a flusher thread:
+// one write and one fsync per commit interval, however many edits arrived.
+// Records carry sequence numbers, so replay skips those the snapshot
+// already includes. Bulk increments are not journaled; values are as of
+// the last snapshot plus the edits after it.
+//
+// A failed commit leaves a hole, so the journal stops accepting records
+// and reports failed() until a compaction covers the lost edits.
+class CounterJournal : public CounterManager::Observer {
+     Q_DISABLE_COPY(CounterJournal)
+public:
+    explicit CounterJournal(const QString &directory, int commitIntervalMs = 10);
+    ~CounterJournal() override;
+
+    // Rebuilds counters from the snapshot and the segments after it.
+    // Returns false with an empty error if there is nothing to recover.
+    bool recover(std::vector<uint64_t> &ids, std::vector<CounterManager::Value> &values, QString *error = nullptr);
+
+    // Starts appending to a fresh segment and starts the flusher.
+    bool open(QString *error = nullptr);
+    void close();
+
+    // Writes a snapshot of `manager` and drops the segments it covers.
+    // Clears a failure, since the snapshot includes the edits it lost.
+    bool compact(const CounterManager &manager, QString *error = nullptr);
+
+    // True once a commit failed, with its error; edits are not journaled
+    // until the next successful compact().
+    bool failed(QString *error = nullptr) const;
+
+    // Bytes committed to segments since the last compaction.
+    qint64 journalBytes() const { return journalBytes_.load(std::memory_order_relaxed); }
+
+    void counterAdded(uint64_t id, CounterManager::Value value) override;
+    void counterDeleted(uint64_t id) override;
+    void counterSet(uint64_t id, CounterManager::Value value) override;
+
+private:
+    enum RecordType : quint8 { Add = 1, Delete = 2, Set = 3 };
+
+    void append(RecordType type, uint64_t id, CounterManager::Value value);
+    void flushLoop();
+    bool commitBatch(const QByteArray &batch, QString *error);
+    void latch(const QString &error);
+    bool openSegmentLocked(QString *error);
+    QString segmentPath(quint64 index) const;
+    std::vector<quint64> segmentIndexes() const;
+
+    const QString directory_;
+    const int commitIntervalMs_;
+
+    // Edits waiting for the next group commit, the sequence number of the
+    // last one, and the latched commit failure.
+    mutable std::mutex pendingMutex_;
+    std::condition_variable pendingCondition_;
+    QByteArray pending_;
+    quint64 sequence_ = 0;
+    bool failed_ = false;
+    QString failure_;
+    bool stopping_ = false;
+    std::thread flusher_;
+
+    // Current segment; the flusher writes it, compact() rotates it.
+    std::mutex segmentMutex_;
+    QFile segment_;
+    quint64 segmentIndex_ = 0;
+    bool opened_ = false;
+
+    std::atomic<qint64> journalBytes_{0};
+};
+
+#endif // COUNTERJOURNAL_H
@@ -0,0 +1,199 @@
+#include "counterkernels.h"
+
+#include <initializer_list>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define COUNTERKERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+namespace CounterKernels {
+namespace {
+
+void addScalar(int64_t *data, std::size_t count, int64_t delta) {
+    for (std::size_t i = 0; i < count; ++i) {
+        data[i] += delta;
+    }
+}
+
+int64_t sumScalar(const int64_t *data, std::size_t count) {
+    // Unsigned, so wrapping is defined.
+    uint64_t total = 0;
+    for (std::size_t i = 0; i < count; ++i) {
+        total += static_cast<uint64_t>(data[i]);
+    }
+    return static_cast<int64_t>(total);
+}
+
+#ifdef COUNTERKERNELS_X86
+
+__attribute__((target("sse2")))
+void addSse2(int64_t *data, std::size_t count, int64_t delta) {
+    const __m128i step = _mm_set1_epi64x(delta);
+    std::size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i *p = reinterpret_cast<__m128i *>(data + i);
+        _mm_storeu_si128(p, _mm_add_epi64(_mm_loadu_si128(p), step));
+        _mm_storeu_si128(p + 1, _mm_add_epi64(_mm_loadu_si128(p + 1), step));
+    }
+    addScalar(data + i, count - i, delta);
+}
+
+__attribute__((target("sse2")))
+int64_t sumSse2(const int64_t *data, std::size_t count) {
+    // Two accumulators to hide the add latency.
+    __m128i acc0 = _mm_setzero_si128();
+    __m128i acc1 = _mm_setzero_si128();
+    std::size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128i *p = reinterpret_cast<const __m128i *>(data + i);
+        acc0 = _mm_add_epi64(acc0, _mm_loadu_si128(p));
+        acc1 = _mm_add_epi64(acc1, _mm_loadu_si128(p + 1));
+    }
+    alignas(16) uint64_t lanes[2];
+    _mm_store_si128(reinterpret_cast<__m128i *>(lanes), _mm_add_epi64(acc0, acc1));
+    return static_cast<int64_t>(lanes[0] + lanes[1] + static_cast<uint64_t>(sumScalar(data + i, count - i)));
+}
+
+__attribute__((target("avx2")))
+void addAvx2(int64_t *data, std::size_t count, int64_t delta) {
+    const __m256i step = _mm256_set1_epi64x(delta);
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i *p = reinterpret_cast<__m256i *>(data + i);
+        _mm256_storeu_si256(p, _mm256_add_epi64(_mm256_loadu_si256(p), step));
+        _mm256_storeu_si256(p + 1, _mm256_add_epi64(_mm256_loadu_si256(p + 1), step));
+    }
+    for (; i + 4 <= count; i += 4) {
+        __m256i *p = reinterpret_cast<__m256i *>(data + i);
+        _mm256_storeu_si256(p, _mm256_add_epi64(_mm256_loadu_si256(p), step));
+    }
+    addScalar(data + i, count - i, delta);
+}
+
+__attribute__((target("avx2")))
+int64_t sumAvx2(const int64_t *data, std::size_t count) {
+    __m256i acc0 = _mm256_setzero_si256();
+    __m256i acc1 = _mm256_setzero_si256();
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256i *p = reinterpret_cast<const __m256i *>(data + i);
+        acc0 = _mm256_add_epi64(acc0, _mm256_loadu_si256(p));
+        acc1 = _mm256_add_epi64(acc1, _mm256_loadu_si256(p + 1));
+    }
+    alignas(32) uint64_t lanes[4];
+    _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), _mm256_add_epi64(acc0, acc1));
+    return static_cast<int64_t>(lanes[0] + lanes[1] + lanes[2] + lanes[3]
+                                + static_cast<uint64_t>(sumScalar(data + i, count - i)));
+}
+
+__attribute__((target("avx512f")))
+void addAvx512(int64_t *data, std::size_t count, int64_t delta) {
+    const __m512i step = _mm512_set1_epi64(delta);
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        _mm512_storeu_si512(data + i, _mm512_add_epi64(_mm512_loadu_si512(data + i), step));
+    }
+    if (i < count) {
+        const __mmask8 tail = static_cast<__mmask8>((1u << (count - i)) - 1);
+        const __m512i v = _mm512_maskz_loadu_epi64(tail, data + i);
+        _mm512_mask_storeu_epi64(data + i, tail, _mm512_add_epi64(v, step));
+    }
+}
+
+__attribute__((target("avx512f")))
+int64_t sumAvx512(const int64_t *data, std::size_t count) {
+    __m512i acc0 = _mm512_setzero_si512();
+    __m512i acc1 = _mm512_setzero_si512();
+    std::size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        acc0 = _mm512_add_epi64(acc0, _mm512_loadu_si512(data + i));
+        acc1 = _mm512_add_epi64(acc1, _mm512_loadu_si512(data + i + 8));
+    }
+    if (i + 8 <= count) {
+        acc0 = _mm512_add_epi64(acc0, _mm512_loadu_si512(data + i));
+        i += 8;
+    }
+    if (i < count) {
+        const __mmask8 tail = static_cast<__mmask8>((1u << (count - i)) - 1);
+        acc1 = _mm512_add_epi64(acc1, _mm512_maskz_loadu_epi64(tail, data + i));
+    }
+    alignas(64) uint64_t lanes[8];
+    _mm512_store_si512(lanes, _mm512_add_epi64(acc0, acc1));
+    uint64_t total = 0;
+    for (uint64_t lane : lanes) {
+        total += lane;
+    }
+    return static_cast<int64_t>(total);
+}
+
+#endif // COUNTERKERNELS_X86
+
+const Table scalarTable{Isa::Scalar, addScalar, sumScalar};
+#ifdef COUNTERKERNELS_X86
+const Table sse2Table{Isa::Sse2, addSse2, sumSse2};
+const Table avx2Table{Isa::Avx2, addAvx2, sumAvx2};
+const Table avx512Table{Isa::Avx512, addAvx512, sumAvx512};
+#endif
+
+bool isSupported(Isa isa) {
+    switch (isa) {
+    case Isa::Scalar:
+        return true;
+#ifdef COUNTERKERNELS_X86
+    case Isa::Sse2:
+        return __builtin_cpu_supports("sse2");
+    case Isa::Avx2:
+        return __builtin_cpu_supports("avx2");
+    case Isa::Avx512:
+        return __builtin_cpu_supports("avx512f");
+#else
+    default:
+        return false;
+#endif
+    }
+    return false;
+}
+
+const Table &detect() {
+    for (Isa isa : {Isa::Avx512, Isa::Avx2, Isa::Sse2}) {
+        if (const Table *table = forIsa(isa)) {
+            return *table;
+        }
+    }
+    return scalarTable;
+}
+
+} // namespace
+
+const Table &active() {
+    static const Table &table = detect();
+    return table;
+}
+
+const Table *forIsa(Isa isa) {
+    if (!isSupported(isa)) return nullptr;
+    switch (isa) {
+    case Isa::Scalar: return &scalarTable;
+#ifdef COUNTERKERNELS_X86
+    case Isa::Sse2: return &sse2Table;
+    case Isa::Avx2: return &avx2Table;
+    case Isa::Avx512: return &avx512Table;
+#else
+    default: return nullptr;
+#endif
+    }
+    return nullptr;
+}
+
+const char *isaName(Isa isa) {
+    switch (isa) {
+    case Isa::Scalar: return "scalar";
+    case Isa::Sse2: return "sse2";
+    case Isa::Avx2: return "avx2";
+    case Isa::Avx512: return "avx512";
+    }
+    return "?";
+}
+
+} // namespace CounterKernels
@@ -0,0 +1,34 @@
+#ifndef COUNTERKERNELS_H
+#define COUNTERKERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Vectorized bulk operations over packed 64-bit counter arrays. The widest
+// instruction set supported by the running CPU is picked once at startup;
+// builds for other architectures or compilers only get the scalar kernels.
+namespace CounterKernels {
+
+enum class Isa { Scalar, Sse2, Avx2, Avx512 };
+
+struct Table {
+    Isa isa;
+    // data[i] += delta for every i < count.
+    void (*add)(int64_t *data, std::size_t count, int64_t delta);
+    // Sum of data[0..count) modulo 2^64. Wraps instead of overflowing, so
+    // the difference of two sums is exact whenever the true difference
+    // fits in 64 bits.
+    int64_t (*sum)(const int64_t *data, std::size_t count);
+};
+
+// Kernels for the best ISA available on this machine.
+const Table &active();
+
+// Kernels for a specific ISA, or nullptr if the CPU or build lacks it.
+const Table *forIsa(Isa isa);
+
+const char *isaName(Isa isa);
+
+} // namespace CounterKernels
+
+#endif // COUNTERKERNELS_H
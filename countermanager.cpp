@@ -0,0 +1,646 @@
+#include "countermanager.h"
+#include "counterkernels.h"
+
+#include <algorithm>
+#include <limits>
+#include <new>
+#include <thread>
+
+namespace {
+
+// Slot of a released handle table entry.
+constexpr std::size_t kNoSlot = std::numeric_limits<std::size_t>::max();
+
+std::size_t handleEntry(CounterManager::Handle handle) {
+    return static_cast<std::size_t>(handle & 0xffffffffu);
+}
+
+uint32_t handleGeneration(CounterManager::Handle handle) {
+    return static_cast<uint32_t>(handle >> 32);
+}
+
+} // namespace
+
+CounterManager::CounterManager(StorageMode mode)
+    : mode_(mode) {
+}
+
+CounterManager::Handle CounterManager::addCounter(Value value) {
+    if (mode_ == StorageMode::Atomic) {
+        auto lock = lockStructure();
+        if (atomicSize_ == atomicCapacity_) {
+            reserveAtomic(std::max<std::size_t>(16, atomicCapacity_ * 2));
+        }
+        const Handle handle = allocateHandle(atomicSize_);
+        atomicCounters_[atomicSize_++].store(value, std::memory_order_relaxed);
+        index_.append();
+        changedAt_.push_back(generation_.load(std::memory_order_relaxed));
+        ids_.push_back(nextId_);
+        handles_.push_back(handle);
+        addToTotal(value);
+        if (observer_) observer_->counterAdded(nextId_, value);
+        ++nextId_;
+        return handle;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    const Handle handle = allocateHandle(counters_.size());
+    counters_.push_back(value);
+    index_.append();
+    changedAt_.push_back(generation_.load(std::memory_order_relaxed));
+    ids_.push_back(nextId_);
+    handles_.push_back(handle);
+    addToTotal(value);
+    if (observer_) observer_->counterAdded(nextId_, value);
+    ++nextId_;
+    return handle;
+}
+
+void CounterManager::deleteCounter(int index) {
+    if (mode_ == StorageMode::Atomic) {
+        auto lock = lockStructure();
+        if (index < 0 || index >= static_cast<int>(index_.live())) return;
+        removeSlot(index_.select(index), index);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (index < 0 || index >= static_cast<int>(index_.live())) return;
+    removeSlot(index_.select(index), index);
+}
+
+void CounterManager::setCounter(int index, Value value) {
+    if (mode_ == StorageMode::Atomic) {
+        auto lock = lockStructure();
+        if (index < 0 || index >= static_cast<int>(index_.live())) return;
+        const std::size_t slot = index_.select(index);
+        addToTotal(value, atomicCounters_[slot].exchange(value, std::memory_order_relaxed));
+        changedAt_[slot] = generation_.load(std::memory_order_relaxed);
+        if (observer_) observer_->counterSet(ids_[slot], value);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (index < 0 || index >= static_cast<int>(index_.live())) return;
+    const std::size_t slot = index_.select(index);
+    addToTotal(value, counters_[slot]);
+    counters_[slot] = value;
+    changedAt_[slot] = generation_.load(std::memory_order_relaxed);
+    if (observer_) observer_->counterSet(ids_[slot], value);
+}
+
+bool CounterManager::deleteByHandle(Handle handle) {
+    std::size_t slot = 0;
+    if (mode_ == StorageMode::Atomic) {
+        auto lock = lockStructure();
+        if (!findSlot(handle, &slot)) return false;
+        removeSlot(slot, index_.rank(slot));
+        return true;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!findSlot(handle, &slot)) return false;
+    removeSlot(slot, index_.rank(slot));
+    return true;
+}
+
+bool CounterManager::setByHandle(Handle handle, Value value) {
+    std::size_t slot = 0;
+    if (mode_ == StorageMode::Atomic) {
+        auto lock = lockStructure();
+        if (!findSlot(handle, &slot)) return false;
+        addToTotal(value, atomicCounters_[slot].exchange(value, std::memory_order_relaxed));
+        changedAt_[slot] = generation_.load(std::memory_order_relaxed);
+        if (observer_) observer_->counterSet(ids_[slot], value);
+        return true;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!findSlot(handle, &slot)) return false;
+    addToTotal(value, counters_[slot]);
+    counters_[slot] = value;
+    changedAt_[slot] = generation_.load(std::memory_order_relaxed);
+    if (observer_) observer_->counterSet(ids_[slot], value);
+    return true;
+}
+
+bool CounterManager::valueByHandle(Handle handle, Value *value) const {
+    std::size_t slot = 0;
+    if (mode_ == StorageMode::Atomic) {
+        std::shared_lock<std::shared_mutex> lock(structureMutex_);
+        if (!findSlot(handle, &slot)) return false;
+        *value = loadSlot(slot);
+        return true;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!findSlot(handle, &slot)) return false;
+    *value = loadSlot(slot);
+    return true;
+}
+
+CounterManager::Handle CounterManager::handleAt(int index) const {
+    if (mode_ == StorageMode::Atomic) {
+        std::shared_lock<std::shared_mutex> lock(structureMutex_);
+        if (index < 0 || index >= static_cast<int>(index_.live())) return kNullHandle;
+        return handles_[index_.select(index)];
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (index < 0 || index >= static_cast<int>(index_.live())) return kNullHandle;
+    return handles_[index_.select(index)];
+}
+
+int CounterManager::rowOf(Handle handle) const {
+    std::size_t slot = 0;
+    if (mode_ == StorageMode::Atomic) {
+        std::shared_lock<std::shared_mutex> lock(structureMutex_);
+        return findSlot(handle, &slot) ? static_cast<int>(index_.rank(slot)) : -1;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    return findSlot(handle, &slot) ? static_cast<int>(index_.rank(slot)) : -1;
+}
+
+std::unique_lock<std::shared_mutex> CounterManager::lockStructure() const {
+    // shared_mutex may prefer readers, and free-running increment passes
+    // re-take the shared lock back to back; announce the writer first so
+    // they step aside.
+    writersPending_.fetch_add(1, std::memory_order_acq_rel);
+    std::unique_lock<std::shared_mutex> lock(structureMutex_);
+    writersPending_.fetch_sub(1, std::memory_order_acq_rel);
+    return lock;
+}
+
+std::shared_lock<std::shared_mutex> CounterManager::shareStructureForIncrement() const {
+    while (writersPending_.load(std::memory_order_acquire) > 0) {
+        std::this_thread::yield();
+    }
+    return std::shared_lock<std::shared_mutex>(structureMutex_);
+}
+
+void CounterManager::setObserver(Observer *observer) {
+    auto structureLock = lockStructure();
+    std::lock_guard<std::mutex> lock(mutex_);
+    observer_ = observer;
+}
+
+std::vector<CounterManager::Value> CounterManager::getCounters() const {
+    std::vector<Value> counters;
+    if (mode_ == StorageMode::Atomic) {
+        std::shared_lock<std::shared_mutex> lock(structureMutex_);
+        gatherLive(counters);
+        return counters;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    gatherLive(counters);
+    return counters;
+}
+
+void CounterManager::getCountersWithIds(std::vector<uint64_t> &ids, std::vector<Value> &values) const {
+    if (mode_ == StorageMode::Atomic) {
+        std::shared_lock<std::shared_mutex> lock(structureMutex_);
+        gatherLive(values, &ids);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    gatherLive(values, &ids);
+}
+
+CounterManager::Value CounterManager::counterAt(int index) const {
+    if (mode_ == StorageMode::Atomic) {
+        std::shared_lock<std::shared_mutex> lock(structureMutex_);
+        if (index < 0 || index >= static_cast<int>(index_.live())) return 0;
+        return loadSlot(index_.select(index));
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (index < 0 || index >= static_cast<int>(index_.live())) return 0;
+    return loadSlot(index_.select(index));
+}
+
+std::vector<CounterManager::Value> CounterManager::getRange(int first, int count,
+                                                            std::vector<Handle> *handles) const {
+    std::vector<Value> range;
+    if (handles) handles->clear();
+    if (first < 0 || count <= 0) return range;
+
+    auto copy = [&]() {
+        const std::size_t begin = std::min<std::size_t>(first, index_.live());
+        const std::size_t end = std::min<std::size_t>(begin + count, index_.live());
+        range.resize(end - begin);
+        if (handles) handles->resize(end - begin);
+        if (range.empty()) return;
+        std::size_t slot = index_.select(begin);
+        for (std::size_t i = 0; i < range.size(); ++i, slot = index_.nextLive(slot + 1)) {
+            range[i] = loadSlot(slot);
+            if (handles) (*handles)[i] = handles_[slot];
+        }
+    };
+
+    if (mode_ == StorageMode::Atomic) {
+        std::shared_lock<std::shared_mutex> lock(structureMutex_);
+        copy();
+        return range;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    copy();
+    return range;
+}
+
+int CounterManager::count() const {
+    if (mode_ == StorageMode::Atomic) {
+        std::shared_lock<std::shared_mutex> lock(structureMutex_);
+        return static_cast<int>(index_.live());
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    return static_cast<int>(index_.live());
+}
+
+std::size_t CounterManager::tombstoneCount() const {
+    if (mode_ == StorageMode::Atomic) {
+        std::shared_lock<std::shared_mutex> lock(structureMutex_);
+        return index_.dead();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    return index_.dead();
+}
+
+void CounterManager::incrementAll() {
+    incrementAllBy(1);
+}
+
+void CounterManager::incrementAllBy(int delta) {
+    // Dead slots are incremented along with the live ones, which keeps the
+    // loop branch free; only live counters go into the total.
+    if (mode_ == StorageMode::Atomic) {
+        auto lock = shareStructureForIncrement();
+        // Only the incrementer writes under the shared lock, so a relaxed
+        // load/store pair is enough and avoids a locked RMW per counter.
+        for (std::size_t i = 0; i < atomicSize_; ++i) {
+            std::atomic<int64_t>& counter = atomicCounters_[i];
+            counter.store(counter.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+        }
+        addToTotal(static_cast<Value>(index_.live()) * delta);
+        ticks_.fetch_add(1, std::memory_order_relaxed);
+        markAllChanged();
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    CounterKernels::active().add(counters_.data(), counters_.size(), delta);
+    addToTotal(static_cast<Value>(index_.live()) * delta);
+    ticks_.fetch_add(1, std::memory_order_relaxed);
+    markAllChanged();
+}
+
+std::size_t CounterManager::incrementShard(std::size_t shard, std::size_t shardCount, int delta) {
+    std::size_t begin = 0;
+    std::size_t end = 0;
+
+    if (mode_ == StorageMode::Atomic) {
+        auto lock = shareStructureForIncrement();
+        shardBounds(atomicSize_, kCacheLineSize / sizeof(int64_t), shard, shardCount, begin, end);
+        for (std::size_t i = begin; i < end; ++i) {
+            std::atomic<int64_t>& counter = atomicCounters_[i];
+            counter.store(counter.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+        }
+        const std::size_t live = index_.dead() == 0 ? end - begin : index_.countLive(begin, end);
+        addToTotal(static_cast<Value>(live) * delta);
+        if (shard == 0) ticks_.fetch_add(1, std::memory_order_relaxed);
+        markAllChanged();
+        return live;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    shardBounds(counters_.size(), kCacheLineSize / sizeof(Value), shard, shardCount, begin, end);
+    CounterKernels::active().add(counters_.data() + begin, end - begin, delta);
+    const std::size_t live = index_.dead() == 0 ? end - begin : index_.countLive(begin, end);
+    addToTotal(static_cast<Value>(live) * delta);
+    if (shard == 0) ticks_.fetch_add(1, std::memory_order_relaxed);
+    markAllChanged();
+    return live;
+}
+
+void CounterManager::setCounters(const std::vector<Value>& counters) {
+    std::vector<uint64_t> ids(counters.size());
+    for (std::size_t i = 0; i < ids.size(); ++i) {
+        ids[i] = i + 1;
+    }
+    setCounters(counters, ids);
+}
+
+void CounterManager::setCounters(const std::vector<Value>& counters, const std::vector<uint64_t>& ids) {
+    const uint64_t nextId = ids.empty() ? 1 : ids.back() + 1;
+
+    if (mode_ == StorageMode::Atomic) {
+        auto lock = lockStructure();
+        if (counters.size() > atomicCapacity_) {
+            reserveAtomic(counters.size());
+        }
+        for (std::size_t i = 0; i < counters.size(); ++i) {
+            atomicCounters_[i].store(counters[i], std::memory_order_relaxed);
+        }
+        atomicSize_ = counters.size();
+        index_.reset(counters.size());
+        compacting_ = false;
+        shifts_.clear();
+        resetHandles(counters.size());
+        ids_ = ids;
+        nextId_ = nextId;
+        changedAt_.assign(counters.size(), 0);
+        total_.store(static_cast<uint64_t>(CounterKernels::active().sum(counters.data(), counters.size())),
+                 std::memory_order_relaxed);
+        markAllChanged();
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    counters_ = counters;
+    index_.reset(counters.size());
+    compacting_ = false;
+    shifts_.clear();
+    resetHandles(counters.size());
+    ids_ = ids;
+    nextId_ = nextId;
+    changedAt_.assign(counters.size(), 0);
+    total_.store(static_cast<uint64_t>(CounterKernels::active().sum(counters.data(), counters.size())),
+                 std::memory_order_relaxed);
+    markAllChanged();
+}
+
+CounterManager::Value CounterManager::total() const {
+    return static_cast<Value>(total_.load(std::memory_order_relaxed));
+}
+
+uint64_t CounterManager::ticks() const {
+    return ticks_.load(std::memory_order_relaxed);
+}
+
+CounterManager::Changes CounterManager::changesSince(uint64_t token, int first, int count) const {
+    Changes changes;
+    // Changes tagged with the returned token show up again on the next
+    // call, which covers writers that read the generation just before this
+    // bump and store their tag after the scan below.
+    changes.token = generation_.fetch_add(1, std::memory_order_relaxed);
+
+    if (mode_ == StorageMode::Atomic) {
+        std::shared_lock<std::shared_mutex> lock(structureMutex_);
+        collectChangedRows(token, first, count, changes);
+        return changes;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    collectChangedRows(token, first, count, changes);
+    return changes;
+}
+
+bool CounterManager::compactStep(std::size_t maxSlots) {
+    if (mode_ == StorageMode::Atomic) {
+        auto lock = lockStructure();
+        return compactLocked(maxSlots);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    return compactLocked(maxSlots);
+}
+
+void CounterManager::collectChangedRows(uint64_t token, int first, int count, Changes &changes) const {
+    if (bulkGeneration_.load(std::memory_order_relaxed) >= token) {
+        changes.all = true;
+        return;
+    }
+    if (shiftsTrimmed_ >= token) {
+        changes.all = true;
+        return;
+    }
+    if (first < 0 || count <= 0) return;
+
+    // Rows at or behind the earliest delete since the token moved.
+    std::size_t shiftedFrom = index_.live();
+    for (auto it = shifts_.rbegin(); it != shifts_.rend() && it->first >= token; ++it) {
+        shiftedFrom = std::min(shiftedFrom, it->second);
+    }
+
+    const std::size_t begin = std::min<std::size_t>(first, index_.live());
+    const std::size_t end = std::min<std::size_t>(begin + count, index_.live());
+    if (begin == end) return;
+    std::size_t slot = index_.select(begin);
+    for (std::size_t row = begin; row < end; ++row, slot = index_.nextLive(slot + 1)) {
+        if (row >= shiftedFrom || changedAt_[slot] >= token) {
+            changes.rows.push_back(static_cast<int>(row));
+        }
+    }
+}
+
+// Called on every increment pass, possibly from several shards at once;
+// only writes the shared line when the generation actually moved, and never
+// moves it backwards.
+void CounterManager::markAllChanged() {
+    const uint64_t generation = generation_.load(std::memory_order_relaxed);
+    uint64_t bulk = bulkGeneration_.load(std::memory_order_relaxed);
+    while (bulk < generation
+           && !bulkGeneration_.compare_exchange_weak(bulk, generation, std::memory_order_relaxed)) {
+    }
+}
+
+// Callers hold the lock of the active storage mode, except concurrent
+// shard increments in Atomic mode, hence the atomic add.
+void CounterManager::addToTotal(Value added, Value removed) {
+    total_.fetch_add(static_cast<uint64_t>(added) - static_cast<uint64_t>(removed), std::memory_order_relaxed);
+}
+
+// Rows from `from` on moved up by one after a delete.
+void CounterManager::recordShift(std::size_t from) {
+    const uint64_t generation = generation_.load(std::memory_order_relaxed);
+    if (!shifts_.empty() && shifts_.back().first == generation) {
+        shifts_.back().second = std::min(shifts_.back().second, from);
+        return;
+    }
+    if (shifts_.size() == kMaxShifts) {
+        shiftsTrimmed_ = shifts_.front().first;
+        shifts_.erase(shifts_.begin());
+    }
+    shifts_.emplace_back(generation, from);
+}
+
+CounterManager::Value CounterManager::loadSlot(std::size_t slot) const {
+    if (mode_ == StorageMode::Atomic) {
+        return atomicCounters_[slot].load(std::memory_order_relaxed);
+    }
+    return counters_[slot];
+}
+
+void CounterManager::storeSlot(std::size_t slot, Value value) {
+    if (mode_ == StorageMode::Atomic) {
+        atomicCounters_[slot].store(value, std::memory_order_relaxed);
+    } else {
+        counters_[slot] = value;
+    }
+}
+
+// Copies the live counters, and optionally their ids, in row order.
+void CounterManager::gatherLive(std::vector<Value> &values, std::vector<uint64_t> *ids) const {
+    if (index_.dead() == 0 && mode_ == StorageMode::Locked) {
+        values.assign(counters_.begin(), counters_.end());
+        if (ids) *ids = ids_;
+        return;
+    }
+
+    values.resize(index_.live());
+    if (ids) ids->resize(index_.live());
+    std::size_t slot = index_.nextLive(0);
+    for (std::size_t row = 0; row < values.size(); ++row, slot = index_.nextLive(slot + 1)) {
+        values[row] = loadSlot(slot);
+        if (ids) (*ids)[row] = ids_[slot];
+    }
+}
+
+void CounterManager::removeSlot(std::size_t slot, std::size_t row) {
+    addToTotal(0, loadSlot(slot));
+    if (observer_) observer_->counterDeleted(ids_[slot]);
+    releaseHandle(handles_[slot]);
+    index_.kill(slot);
+    recordShift(row);
+    trimTail();
+}
+
+// Drops dead slots at the end right away; deleting the last row is common
+// and needs no compaction. Stops at the read cursor of a running pass.
+void CounterManager::trimTail() {
+    const std::size_t floor = compacting_ ? compactRead_ : 0;
+    std::size_t size = index_.size();
+    while (size > floor && !index_.isLive(size - 1)) {
+        --size;
+    }
+    if (size < index_.size()) {
+        truncateSlots(size);
+    }
+}
+
+void CounterManager::truncateSlots(std::size_t slots) {
+    index_.truncate(slots);
+    ids_.resize(slots);
+    changedAt_.resize(slots);
+    handles_.resize(slots);
+    if (mode_ == StorageMode::Atomic) {
+        atomicSize_ = slots;
+    } else {
+        counters_.resize(slots);
+    }
+}
+
+// Caller holds the lock of the active storage mode exclusively.
+bool CounterManager::compactLocked(std::size_t maxSlots) {
+    if (index_.dead() == 0) {
+        compacting_ = false;
+        return false;
+    }
+    if (!compacting_) {
+        compactWrite_ = compactRead_ = index_.nextDead(0);
+        compacting_ = true;
+    }
+
+    const std::size_t begin = compactWrite_;
+    const std::size_t end = std::min(index_.size(), compactRead_ + std::max<std::size_t>(maxSlots, 1));
+    for (; compactRead_ < end; ++compactRead_) {
+        if (!index_.isLive(compactRead_)) continue;
+        storeSlot(compactWrite_, loadSlot(compactRead_));
+        ids_[compactWrite_] = ids_[compactRead_];
+        changedAt_[compactWrite_] = changedAt_[compactRead_];
+        handles_[compactWrite_] = handles_[compactRead_];
+        handleEntries_[handleEntry(handles_[compactWrite_])].slot = compactWrite_;
+        index_.setLive(compactWrite_, true);
+        index_.setLive(compactRead_, false);
+        ++compactWrite_;
+    }
+    index_.reindex(begin, end);
+
+    if (compactRead_ == index_.size()) {
+        truncateSlots(compactWrite_);
+        compacting_ = false;
+    }
+    return index_.dead() > 0;
+}
+
+CounterManager::Handle CounterManager::allocateHandle(std::size_t slot) {
+    std::size_t entry = handleEntries_.size();
+    if (!freeHandles_.empty()) {
+        entry = freeHandles_.back();
+        freeHandles_.pop_back();
+    } else {
+        handleEntries_.push_back({kNoSlot, 1});
+    }
+    handleEntries_[entry].slot = slot;
+    return static_cast<Handle>(handleEntries_[entry].generation) << 32 | entry;
+}
+
+void CounterManager::releaseHandle(Handle handle) {
+    const std::size_t entry = handleEntry(handle);
+    HandleEntry &e = handleEntries_[entry];
+    e.slot = kNoSlot;
+    // Retire the entry instead of wrapping its generation, which would
+    // reissue handles that went stale 2^32 releases ago. Costs one entry
+    // per 2^32 - 1 reuses.
+    if (e.generation == std::numeric_limits<uint32_t>::max()) return;
+    ++e.generation;
+    freeHandles_.push_back(static_cast<uint32_t>(entry));
+}
+
+// Releases every live handle and hands out fresh ones for slots 0..n-1.
+void CounterManager::resetHandles(std::size_t slots) {
+    for (std::size_t entry = 0; entry < handleEntries_.size(); ++entry) {
+        if (handleEntries_[entry].slot != kNoSlot) {
+            releaseHandle(static_cast<Handle>(handleEntries_[entry].generation) << 32 | entry);
+        }
+    }
+    handles_.resize(slots);
+    for (std::size_t slot = 0; slot < slots; ++slot) {
+        handles_[slot] = allocateHandle(slot);
+    }
+}
+
+bool CounterManager::findSlot(Handle handle, std::size_t *slot) const {
+    const std::size_t entry = handleEntry(handle);
+    if (entry >= handleEntries_.size()) return false;
+    const HandleEntry &e = handleEntries_[entry];
+    if (e.generation != handleGeneration(handle) || e.slot == kNoSlot) return false;
+    *slot = e.slot;
+    return true;
+}
+
+void CounterManager::shardBounds(std::size_t size, std::size_t countersPerLine,
+                                 std::size_t shard, std::size_t shardCount,
+                                 std::size_t &begin, std::size_t &end) {
+    const std::size_t lines = (size + countersPerLine - 1) / countersPerLine;
+    const std::size_t count = std::max<std::size_t>(shardCount, 1);
+    begin = std::min(size, lines * shard / count * countersPerLine);
+    end = std::min(size, lines * (shard + 1) / count * countersPerLine);
+}
+
+void CounterManager::AlignedDelete::operator()(std::atomic<int64_t> *p) const {
+    // std::atomic<int64_t> is trivially destructible, so only the storage
+    // has to go back.
+    ::operator delete[](p, std::align_val_t(kCacheLineSize));
+}
+
+// Caller holds structureMutex_ exclusively.
+void CounterManager::reserveAtomic(std::size_t capacity) {
+    void *raw = ::operator new[](capacity * sizeof(std::atomic<int64_t>),
+                                 std::align_val_t(kCacheLineSize));
+    std::atomic<int64_t> *slots = static_cast<std::atomic<int64_t> *>(raw);
+    for (std::size_t i = 0; i < capacity; ++i) {
+        new (slots + i) std::atomic<int64_t>(0);
+    }
+    std::unique_ptr<std::atomic<int64_t>[], AlignedDelete> grown(slots);
+    for (std::size_t i = 0; i < atomicSize_; ++i) {
+        grown[i].store(atomicCounters_[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+    atomicCounters_ = std::move(grown);
+    atomicCapacity_ = capacity;
+}
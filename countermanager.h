@@ -0,0 +1,240 @@
+#ifndef COUNTERMANAGER_H
+#define COUNTERMANAGER_H
+
+#include "slotindex.h"
+
+#include <QtGlobal>
+
+#include <vector>
+#include <mutex>
+#include <shared_mutex>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+
+class CounterManager {
+     Q_DISABLE_COPY(CounterManager)
+public:
+    // Counters are 64-bit so that they cannot overflow in practice, even
+    // at 100 kHz for years.
+    using Value = int64_t;
+
+    // Stable reference to one counter: generation << 32 | handle table entry.
+    // Stays valid while rows move around it and goes stale once the counter
+    // is deleted or setCounters() replaces everything; a stale handle is
+    // never handed out again. kNullHandle is never valid.
+    using Handle = uint64_t;
+    static constexpr Handle kNullHandle = 0;
+
+    // Notified of single-counter edits while the manager lock is held, in
+    // the order they are applied. Used to journal mutations; must be quick.
+    // Bulk operations (increments, setCounters) are not reported.
+    class Observer {
+    public:
+        virtual ~Observer() = default;
+        virtual void counterAdded(uint64_t id, Value value) = 0;
+        virtual void counterDeleted(uint64_t id) = 0;
+        virtual void counterSet(uint64_t id, Value value) = 0;
+    };
+
+    enum class StorageMode {
+        // std::vector guarded by one mutex; incrementAll() sees a consistent
+        // cut, incrementShard() only within its shard.
+        Locked,
+        // Contiguous std::atomic<Value> array. Increments and value reads
+        // only share the structural lock, add/delete take it exclusively.
+        // incrementAll() must not be called from two threads at once.
+        Atomic
+    };
+
+    explicit CounterManager(StorageMode mode = StorageMode::Locked);
+    ~CounterManager() {};
+    StorageMode storageMode() const { return mode_; }
+    // Every counter also gets an id, increasing in creation order, that
+    // survives deletes of other counters and restarts; persistence keys rows
+    // by it, since the stores diff id lists that ascend in row order.
+    Handle addCounter(Value value);
+    // Leaves a tombstone instead of shifting the counters behind the row,
+    // so a delete costs O(log n) under the lock wherever the row is.
+    // compactStep() reclaims the dead slots later.
+    void deleteCounter(int index);
+    void setCounter(int index, Value value);
+
+    // Handle based access, O(1) apart from the delete's row bookkeeping.
+    // Return false (or kNullHandle / -1) when the handle is stale or the
+    // row is out of range.
+    bool deleteByHandle(Handle handle);
+    bool setByHandle(Handle handle, Value value);
+    bool valueByHandle(Handle handle, Value *value) const;
+    Handle handleAt(int index) const;
+    int rowOf(Handle handle) const;
+    std::vector<Value> getCounters() const;
+    // Consistent copy of ids and values, both in row order. Ids ascend.
+    void getCountersWithIds(std::vector<uint64_t> &ids, std::vector<Value> &values) const;
+    Value counterAt(int index) const;
+    // Copies counters [first, first + count), clipped to the current size.
+    // Holds the lock only for the copied range, so it is cheap for small
+    // windows such as the rows visible in a view.
+    // With `handles`, their handles are copied too.
+    std::vector<Value> getRange(int first, int count, std::vector<Handle> *handles = nullptr) const;
+    int count() const;
+    void incrementAll();
+    void incrementAllBy(int delta);
+
+    // Increments one of `shardCount` contiguous partitions of the counters.
+    // Shard boundaries fall on cache-line multiples so workers owning
+    // different shards never write the same line. In Atomic mode shards run
+    // concurrently; in Locked mode they serialize on the mutex. Returns the
+    // number of counters incremented.
+    //
+    // Bounds come from the size at each call, and a pass over all shards
+    // is several calls, so it is not a consistent cut: an add, delete or
+    // compaction step between two of them moves boundaries or slots, and
+    // the counters that cross one get one increment more or less in that
+    // pass. total() stays the exact sum of the counters either way.
+    std::size_t incrementShard(std::size_t shard, std::size_t shardCount, int delta = 1);
+    // Sum of all counters modulo 2^64, maintained on every mutation so it
+    // costs O(1) to read. Lock-free; while increments run concurrently in
+    // Atomic mode it may lag the counters by the pass in flight.
+    Value total() const;
+    // Number of increment passes so far: incrementAll() calls plus passes
+    // over shard 0 by incrementShard(). Each pass adds delta to every
+    // counter, so the tick rate is the per-counter rate.
+    uint64_t ticks() const;
+
+    // Replaces all counters; ids are numbered 1..n. Invalidates all handles.
+    void setCounters(const std::vector<Value>& counters);
+    // Replaces all counters keeping the given ascending ids.
+    void setCounters(const std::vector<Value>& counters, const std::vector<uint64_t>& ids);
+
+    // Installs (or with nullptr removes) the mutation observer.
+    void setObserver(Observer *observer);
+
+    // Change tracking. Every mutation is tagged with the current generation;
+    // bulk operations (increments, setCounters) tag all counters at once,
+    // structural edits tag the rows they touch.
+    struct Changes {
+        // Pass back into the next changesSince() call.
+        uint64_t token = 0;
+        // A bulk operation ran, every counter in the window may differ.
+        bool all = false;
+        // Rows inside the window changed by single-counter edits.
+        std::vector<int> rows;
+    };
+
+    // Reports what changed in rows [first, first + count) since the call
+    // that returned `token`; start with token 0 to get everything. May
+    // report a change twice but never misses one.
+    Changes changesSince(uint64_t token, int first, int count) const;
+
+    // Moves live counters over at most maxSlots tombstoned slots towards
+    // the front and drops the dead tail once a pass is done, so the lock is
+    // held only briefly. Rows keep their order. Returns true while
+    // tombstones remain; meant to be called in a loop from a background
+    // thread.
+    bool compactStep(std::size_t maxSlots = kCompactSlotsPerStep);
+    std::size_t tombstoneCount() const;
+
+    static constexpr std::size_t kCacheLineSize = 64;
+    static constexpr std::size_t kCompactSlotsPerStep = 16384;
+
+private:
+    // Reaches the handle table to exhaust a generation without 2^32 deletes.
+    friend class CounterManagerTest;
+
+    struct AlignedDelete {
+        void operator()(std::atomic<int64_t> *p) const;
+    };
+
+    static void shardBounds(std::size_t size, std::size_t countersPerLine,
+                            std::size_t shard, std::size_t shardCount,
+                            std::size_t &begin, std::size_t &end);
+    // Atomic mode: structure edits take structureMutex_ through these so
+    // that increment passes cannot starve them.
+    std::unique_lock<std::shared_mutex> lockStructure() const;
+    std::shared_lock<std::shared_mutex> shareStructureForIncrement() const;
+    void reserveAtomic(std::size_t capacity);
+    void markAllChanged();
+    void addToTotal(Value added, Value removed = 0);
+    void recordShift(std::size_t from);
+    void collectChangedRows(uint64_t token, int first, int count, Changes &changes) const;
+
+    // Slot helpers; callers hold the lock of the active storage mode.
+    Value loadSlot(std::size_t slot) const;
+    void storeSlot(std::size_t slot, Value value);
+    void gatherLive(std::vector<Value> &values, std::vector<uint64_t> *ids = nullptr) const;
+    void removeSlot(std::size_t slot, std::size_t row);
+    void trimTail();
+    void truncateSlots(std::size_t slots);
+    bool compactLocked(std::size_t maxSlots);
+    Handle allocateHandle(std::size_t slot);
+    void releaseHandle(Handle handle);
+    void resetHandles(std::size_t slots);
+    bool findSlot(Handle handle, std::size_t *slot) const;
+
+    const StorageMode mode_;
+
+    // StorageMode::Locked
+    mutable std::mutex mutex_;
+    std::vector<Value> counters_;
+
+    // StorageMode::Atomic
+    mutable std::shared_mutex structureMutex_;
+    // Writers waiting for structureMutex_; increment passes yield to them.
+    mutable std::atomic<int> writersPending_{0};
+    // Cache-line aligned so shard boundaries line up with real lines.
+    std::unique_ptr<std::atomic<int64_t>[], AlignedDelete> atomicCounters_;
+    std::size_t atomicSize_ = 0;
+    std::size_t atomicCapacity_ = 0;
+
+    // Counter storage is indexed by slot. Deleted counters stay behind as
+    // dead slots until compaction; index_ maps rows to live slots. Guarded
+    // by the lock of the active storage mode, as is everything below that
+    // is not atomic.
+    SlotIndex index_;
+    // Compaction pass in progress: slots [compactWrite_, compactRead_) are
+    // dead, everything before compactRead_ has been visited.
+    bool compacting_ = false;
+    std::size_t compactWrite_ = 0;
+    std::size_t compactRead_ = 0;
+
+    // Change tracking, per slot.
+    mutable std::atomic<uint64_t> generation_{1};
+    std::atomic<uint64_t> bulkGeneration_{0};
+    std::vector<uint64_t> changedAt_;
+    // Deletes as (generation, row): rows from there on moved up by one.
+    // Only the newest kMaxShifts are kept; shiftsTrimmed_ is the generation
+    // of the newest one dropped.
+    static constexpr std::size_t kMaxShifts = 64;
+    std::vector<std::pair<uint64_t, std::size_t>> shifts_;
+    uint64_t shiftsTrimmed_ = 0;
+
+    // Running total kept as unsigned so wrapping is well defined. On its
+    // own line, since every increment pass touches it.
+    alignas(kCacheLineSize) std::atomic<uint64_t> total_{0};
+    std::atomic<uint64_t> ticks_{0};
+
+    // Stable ids, per slot like changedAt_.
+    std::vector<uint64_t> ids_;
+    uint64_t nextId_ = 1;
+
+    // Handle table. Live entries point at their counter's slot, released
+    // ones sit on freeHandles_ with their generation already bumped.
+    // Generations start at 1 and entries whose generation is exhausted are
+    // never reused, so no handle is issued twice and none is kNullHandle.
+    struct HandleEntry {
+        std::size_t slot;
+        uint32_t generation;
+    };
+    std::vector<HandleEntry> handleEntries_;
+    std::vector<uint32_t> freeHandles_;
+    // Handle of each slot.
+    std::vector<Handle> handles_;
+
+    // Guarded by both storage locks, so either mode sees a stable pointer.
+    Observer *observer_ = nullptr;
+};
+
+#endif // COUNTERMANAGER_H
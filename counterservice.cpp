@@ -0,0 +1,77 @@
+#include "counterservice.h"
+#include "dbworker.h"
+
+#include <numeric>
+
+CounterService::CounterService(const EngineConfig &config, QObject *parent)
+    : QObject(parent),
+      config_(config),
+      manager_(config.storageMode),
+      engine_(manager_, config),
+      rates_(manager_) {
+    const bool mapped = config.storeBackend == DbWorker::Backend::Mapped;
+    dbWorker_ = new DbWorker(manager_, config.storeBackend, mapped ? "counters.bin" : "counters.db");
+    dbWorker_->setIncrementSource([this]() {
+        std::vector<uint64_t> shards = engine_.shardIncrements();
+        return std::accumulate(shards.begin(), shards.end(), uint64_t(0));
+    });
+    dbWorker_->setSqliteProfile(config.sqliteProfile);
+    if (!config.journalDirectory.isEmpty()) {
+        dbWorker_->enableJournal(config.journalDirectory, config.journalCompactSec * 1000);
+    }
+    dbWorker_->moveToThread(&dbThread_);
+    connect(&dbThread_, &QThread::finished, dbWorker_, &QObject::deleteLater);
+    connect(dbWorker_, &DbWorker::loaded, this, &CounterService::loaded);
+    connect(dbWorker_, &DbWorker::saveProgress, this, &CounterService::saveProgress);
+    connect(dbWorker_, &DbWorker::saved, this, &CounterService::saved);
+    connect(dbWorker_, &DbWorker::checkpointed, this, &CounterService::checkpointed);
+    dbThread_.start();
+}
+
+CounterService::~CounterService() {
+    stop();
+}
+
+void CounterService::start() {
+    if (!dbWorker_) return;
+    if (config_.autosaveIntervalSec > 0 || config_.autosaveIncrements > 0) {
+        // Armed by a successful load only, on the worker thread; after a
+        // failed one there is nothing safe to checkpoint.
+        DbWorker *worker = dbWorker_;
+        const EngineConfig config = config_;
+        connect(dbWorker_, &DbWorker::loaded, dbWorker_, [worker, config](bool ok) {
+            if (!ok) return;
+            worker->startAutosave(config.autosaveIntervalSec * 1000, config.autosaveIncrements,
+                                  config.autosaveRowsPerSec);
+        });
+    }
+    load();
+
+    engine_.start();
+    rates_.start();
+}
+
+void CounterService::stop() {
+    rates_.stop();
+    engine_.stop();
+
+    dbThread_.quit();
+    dbThread_.wait();
+    // Deleted along with the thread.
+    dbWorker_ = nullptr;
+}
+
+void CounterService::load() {
+    if (!dbWorker_) return;
+    QMetaObject::invokeMethod(dbWorker_, &DbWorker::load, Qt::QueuedConnection);
+}
+
+void CounterService::save() {
+    if (!dbWorker_) return;
+    QMetaObject::invokeMethod(dbWorker_, &DbWorker::save, Qt::QueuedConnection);
+}
+
+void CounterService::compactJournal() {
+    if (!dbWorker_) return;
+    QMetaObject::invokeMethod(dbWorker_, &DbWorker::compactJournal, Qt::QueuedConnection);
+}
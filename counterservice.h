@@ -0,0 +1,61 @@
+#ifndef COUNTERSERVICE_H
+#define COUNTERSERVICE_H
+
+#include "countermanager.h"
+#include "counterengine.h"
+#include "rateestimator.h"
+#include "engineconfig.h"
+
+#include <QObject>
+#include <QString>
+#include <QThread>
+
+class DbWorker;
+
+// Everything that runs the counters without a display: the manager, the
+// increment workers, the rate sampler and the persistence worker on its
+// own thread. Needs a QCoreApplication event loop for the persistence
+// signals; the GUI and the headless driver each own one.
+class CounterService : public QObject {
+    Q_OBJECT
+
+public:
+    explicit CounterService(const EngineConfig &config, QObject *parent = nullptr);
+    ~CounterService();
+
+    CounterManager &manager() { return manager_; }
+    CounterEngine &engine() { return engine_; }
+    RateEstimator &rates() { return rates_; }
+
+    // Queues a load, arms autosave (if configured) for when it succeeds,
+    // then starts the increment workers and the rate sampler.
+    void start();
+    // Stops workers and sampler and shuts the persistence thread down.
+    // Queued saves still run first. Called by the destructor.
+    void stop();
+
+    // Queued to the persistence thread; results arrive as signals.
+    void load();
+    void save();
+    // Snapshots the journal, if enabled, so that bulk edits such as
+    // setCounters(), which it does not record, survive a crash.
+    void compactJournal();
+
+signals:
+    void loaded(bool ok, const QString &error);
+    void saveProgress(int done, int total);
+    void saved(bool ok, const QString &error, int inserted, int updated, int deleted);
+    void checkpointed(bool ok, const QString &error, double durationMs, qint64 rows, bool complete);
+
+private:
+    const EngineConfig config_;
+    CounterManager manager_;
+    CounterEngine engine_;
+    RateEstimator rates_;
+
+    // dbWorker_ lives on dbThread_ and is deleted when the thread finishes.
+    QThread dbThread_;
+    DbWorker *dbWorker_;
+};
+
+#endif // COUNTERSERVICE_H
@@ -0,0 +1,340 @@
+#include "counterstore.h"
+
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QSqlRecord>
+#include <QStringList>
+#include <QVariant>
+
+#include <algorithm>
+#include <limits>
+
+namespace {
+
+bool fail(QString *error, const QString &message) {
+    if (error) *error = message;
+    return false;
+}
+
+bool fail(QString *error, const QSqlQuery &query) {
+    return fail(error, query.lastError().text());
+}
+
+} // namespace
+
+// Prepared once and reused by every save on the same connection.
+struct CounterStore::Statements {
+    explicit Statements(const QSqlDatabase &db) : insert(db), update(db), remove(db) {}
+
+    QSqlQuery insert;
+    QSqlQuery update;
+    QSqlQuery remove;
+};
+
+CounterStore::CounterStore(const QString &connectionName)
+    : connectionName_(connectionName) {
+}
+
+CounterStore::~CounterStore() = default;
+
+bool CounterStore::load(CounterManager &manager, QString *error) {
+    // Cleared below once the table is read; until then writes are refused.
+    loadFailed_ = true;
+    QSqlDatabase db = QSqlDatabase::database(connectionName_);
+    if (!db.isOpen()) {
+        return fail(error, "Database connection is not open");
+    }
+    if (!ensureSchema(db, error)) {
+        return false;
+    }
+
+    std::vector<uint64_t> ids;
+    std::vector<CounterManager::Value> values;
+    if (!readTable(db, ids, values, error)) {
+        return false;
+    }
+
+    // One setCounters() call; the model picks the new size up in a single
+    // reset when the load is reported.
+    manager.setCounters(values, ids);
+    savedIds_ = std::move(ids);
+    savedValues_ = std::move(values);
+    synced_ = true;
+    loadFailed_ = false;
+    return true;
+}
+
+bool CounterStore::readTable(QSqlDatabase &db, std::vector<uint64_t> &ids,
+                             std::vector<CounterManager::Value> &values, QString *error) {
+    // Forward-only: the driver then keeps just the current row instead of
+    // caching the whole result set for random access.
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    if (!query.exec("SELECT COUNT(*) FROM counters") || !query.next()) {
+        return fail(error, query);
+    }
+    const std::size_t expected = static_cast<std::size_t>(query.value(0).toLongLong());
+    query.finish();
+
+    ids.clear();
+    values.clear();
+    ids.reserve(expected);
+    values.reserve(expected);
+
+    if (!query.exec("SELECT id, value FROM counters ORDER BY id")) {
+        return fail(error, query);
+    }
+    while (query.next()) {
+        ids.push_back(query.value(0).toULongLong());
+        values.push_back(query.value(1).toLongLong());
+    }
+    if (query.lastError().isValid()) {
+        return fail(error, query);
+    }
+    return true;
+}
+
+bool CounterStore::save(const CounterManager &manager, SaveStats *stats, QString *error,
+                        const Progress &progress) {
+    return write(manager, std::numeric_limits<int>::max(), stats, error, progress);
+}
+
+bool CounterStore::checkpoint(const CounterManager &manager, int maxWrites,
+                              SaveStats *stats, QString *error) {
+    return write(manager, std::max(1, maxWrites), stats, error, Progress());
+}
+
+bool CounterStore::write(const CounterManager &manager, int maxWrites,
+                         SaveStats *stats, QString *error, const Progress &progress) {
+    // The manager does not hold what the table does; a diff against it
+    // would delete every stored row.
+    if (loadFailed_) {
+        return fail(error, "Not saving over the counters table: it failed to load");
+    }
+    QSqlDatabase db = QSqlDatabase::database(connectionName_);
+    if (!db.isOpen()) {
+        return fail(error, "Database connection is not open");
+    }
+    if (!ensureSchema(db, error)) {
+        return false;
+    }
+
+    // Without a known image, read the table back and diff against it. The
+    // table is never cleared, so a bounded write that stops early (or a
+    // crash after it commits) leaves every row it did not reach intact.
+    if (!synced_) {
+        if (!readTable(db, savedIds_, savedValues_, error)) {
+            return false;
+        }
+        resumeId_ = 0;
+        synced_ = true;
+    }
+
+    std::vector<uint64_t> ids;
+    std::vector<CounterManager::Value> values;
+    manager.getCountersWithIds(ids, values);
+
+    if (!db.transaction()) {
+        return fail(error, db.lastError().text());
+    }
+
+    if (!statements_) {
+        auto statements = std::make_unique<Statements>(db);
+        if (!statements->insert.prepare("INSERT INTO counters (id, value) VALUES (?, ?)")
+            || !statements->update.prepare("UPDATE counters SET value = ? WHERE id = ?")
+            || !statements->remove.prepare("DELETE FROM counters WHERE id = ?")) {
+            db.rollback();
+            return fail(error, db.lastError().text());
+        }
+        statements_ = std::move(statements);
+    }
+    QSqlQuery &insert = statements_->insert;
+    QSqlQuery &update = statements_->update;
+    QSqlQuery &remove = statements_->remove;
+
+    // Both id lists are ascending, so a merge pass finds every insert,
+    // update and delete. The pass starts where the previous bounded write
+    // stopped and wraps around, so repeated checkpoints cover every id.
+    const std::size_t iStart = std::lower_bound(ids.begin(), ids.end(), resumeId_) - ids.begin();
+    const std::size_t jStart = std::lower_bound(savedIds_.begin(), savedIds_.end(), resumeId_) - savedIds_.begin();
+    const std::size_t iBounds[2][2] = {{iStart, ids.size()}, {0, iStart}};
+    const std::size_t jBounds[2][2] = {{jStart, savedIds_.size()}, {0, jStart}};
+
+    SaveStats result;
+    const int total = static_cast<int>(ids.size() + savedIds_.size());
+    int writes = 0;
+    int processed = 0;
+    int stopPass = -1;
+    uint64_t stopId = 0;
+    for (int pass = 0; pass < 2 && stopPass < 0; ++pass) {
+        std::size_t i = iBounds[pass][0];
+        std::size_t j = jBounds[pass][0];
+        const std::size_t iEnd = iBounds[pass][1];
+        const std::size_t jEnd = jBounds[pass][1];
+        while (i < iEnd || j < jEnd) {
+            if (progress && (++processed & 4095) == 0) {
+                progress(processed, total);
+            }
+
+            const bool insertNext = j == jEnd || (i < iEnd && ids[i] < savedIds_[j]);
+            const bool deleteNext = !insertNext && (i == iEnd || savedIds_[j] < ids[i]);
+            const bool updateNext = !insertNext && !deleteNext && values[i] != savedValues_[j];
+            if ((insertNext || deleteNext || updateNext) && writes == maxWrites) {
+                stopPass = pass;
+                stopId = insertNext ? ids[i] : savedIds_[j];
+                break;
+            }
+
+            QSqlQuery *query = nullptr;
+            if (insertNext) {
+                insert.bindValue(0, static_cast<qlonglong>(ids[i]));
+                insert.bindValue(1, static_cast<qlonglong>(values[i]));
+                query = &insert;
+                ++result.inserted;
+                ++i;
+            } else if (deleteNext) {
+                remove.bindValue(0, static_cast<qlonglong>(savedIds_[j]));
+                query = &remove;
+                ++result.deleted;
+                ++j;
+            } else {
+                if (updateNext) {
+                    update.bindValue(0, static_cast<qlonglong>(values[i]));
+                    update.bindValue(1, static_cast<qlonglong>(ids[i]));
+                    query = &update;
+                    ++result.updated;
+                }
+                ++i;
+                ++j;
+            }
+
+            if (query) {
+                ++writes;
+                if (!query->exec()) {
+                    const QString message = query->lastError().text();
+                    db.rollback();
+                    synced_ = false;
+                    statements_.reset();
+                    return fail(error, message);
+                }
+            }
+        }
+    }
+
+    if (!db.commit()) {
+        db.rollback();
+        synced_ = false;
+        return fail(error, db.lastError().text());
+    }
+
+    if (stopPass < 0) {
+        savedIds_ = std::move(ids);
+        savedValues_ = std::move(values);
+        resumeId_ = 0;
+    } else {
+        // Ids in [resumeId_, stopId) (wrapping) now match the manager; the
+        // rest of the table is unchanged.
+        const uint64_t startId = resumeId_;
+        auto written = [&](uint64_t id) {
+            return stopPass == 0 ? (id >= startId && id < stopId)
+                                 : (id >= startId || id < stopId);
+        };
+        mergeWritten(ids, values, written);
+        resumeId_ = stopId;
+    }
+    synced_ = true;
+
+    result.complete = stopPass < 0;
+    result.rows = result.inserted + result.updated + result.deleted;
+    if (progress) progress(total, total);
+    if (stats) *stats = result;
+    return true;
+}
+
+// Rebuilds the saved image after a bounded write: current rows for ids the
+// write covered, previously saved rows for everything else.
+void CounterStore::mergeWritten(const std::vector<uint64_t> &ids, const std::vector<CounterManager::Value> &values,
+                                const std::function<bool(uint64_t)> &written) {
+    std::vector<uint64_t> mergedIds;
+    std::vector<CounterManager::Value> mergedValues;
+    mergedIds.reserve(std::max(ids.size(), savedIds_.size()));
+    mergedValues.reserve(mergedIds.capacity());
+
+    std::size_t i = 0;
+    std::size_t j = 0;
+    while (i < ids.size() || j < savedIds_.size()) {
+        const uint64_t id = j == savedIds_.size() || (i < ids.size() && ids[i] < savedIds_[j])
+                                ? ids[i] : savedIds_[j];
+        const bool inCurrent = i < ids.size() && ids[i] == id;
+        const bool inSaved = j < savedIds_.size() && savedIds_[j] == id;
+        if (written(id)) {
+            if (inCurrent) {
+                mergedIds.push_back(id);
+                mergedValues.push_back(values[i]);
+            }
+        } else if (inSaved) {
+            mergedIds.push_back(id);
+            mergedValues.push_back(savedValues_[j]);
+        }
+        if (inCurrent) ++i;
+        if (inSaved) ++j;
+    }
+
+    savedIds_ = std::move(mergedIds);
+    savedValues_ = std::move(mergedValues);
+}
+
+void CounterStore::invalidate() {
+    synced_ = false;
+    // The caller vouches for the manager now, as journal recovery does.
+    loadFailed_ = false;
+    resumeId_ = 0;
+    savedIds_.clear();
+    savedValues_.clear();
+}
+
+void CounterStore::releaseConnection() {
+    statements_.reset();
+}
+
+bool CounterStore::ensureSchema(QSqlDatabase &db, QString *error) {
+    QSqlQuery query(db);
+    const QStringList tables = db.tables();
+    // Migrated by ChunkedCounterStore; starting an empty `counters` table
+    // here would hide the chunked counters and the next save would stick.
+    if (tables.contains("counter_chunks")) {
+        return fail(error, "Database holds chunked counters (counter_chunks); open it with --store chunked");
+    }
+    if (!tables.contains("counters")) {
+        if (!query.exec("CREATE TABLE counters (id INTEGER PRIMARY KEY, value INTEGER)")) {
+            return fail(error, query);
+        }
+        return true;
+    }
+
+    if (db.record("counters").contains("id")) {
+        return true;
+    }
+
+    // Pre-id schema `counters(value INTEGER)`: keep the row order by
+    // turning the implicit rowid into the counter id.
+    if (!db.transaction()) {
+        return fail(error, db.lastError().text());
+    }
+    const QStringList migration = {
+        "ALTER TABLE counters RENAME TO counters_v1",
+        "CREATE TABLE counters (id INTEGER PRIMARY KEY, value INTEGER)",
+        "INSERT INTO counters (id, value) SELECT rowid, value FROM counters_v1 ORDER BY rowid",
+        "DROP TABLE counters_v1"
+    };
+    for (const QString &statement : migration) {
+        if (!query.exec(statement)) {
+            db.rollback();
+            return fail(error, query);
+        }
+    }
+    if (!db.commit()) {
+        return fail(error, db.lastError().text());
+    }
+    return true;
+}
@@ -0,0 +1,71 @@
+#ifndef COUNTERSTORE_H
+#define COUNTERSTORE_H
+
+#include "counterbackend.h"
+
+#include <QString>
+#include <QSqlDatabase>
+
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+// Persists a CounterManager in the `counters` table of a SQLite connection,
+// keyed by the stable counter id. The store remembers what the database
+// holds after each load/save, so a save only issues INSERT/UPDATE/DELETE
+// for counters that were added, changed or removed since.
+class CounterStore : public CounterBackend {
+     Q_DISABLE_COPY(CounterStore)
+public:
+    // Keeps prepared statements on the connection until destroyed, so
+    // destroy the store before removing the connection.
+    explicit CounterStore(const QString &connectionName = QLatin1String(QSqlDatabase::defaultConnection));
+    ~CounterStore() override;
+
+    // Creates or migrates the schema and replaces the manager's counters
+    // with the stored ones.
+    bool load(CounterManager &manager, QString *error = nullptr) override;
+
+    // Writes the difference between the manager and the database. Without
+    // a prior load/save the table is read back first and diffed the same
+    // way.
+    bool save(const CounterManager &manager, SaveStats *stats = nullptr, QString *error = nullptr,
+              const Progress &progress = Progress()) override;
+
+    // Like save() but issues at most maxWrites row writes. The next
+    // checkpoint continues after the last id written, so a sequence of
+    // bounded checkpoints eventually covers every counter.
+    bool checkpoint(const CounterManager &manager, int maxWrites,
+                    SaveStats *stats = nullptr, QString *error = nullptr) override;
+
+    // Forget what the database holds; the next save reads it back.
+    void invalidate() override;
+    void releaseConnection() override;
+
+private:
+    struct Statements;
+
+    bool ensureSchema(QSqlDatabase &db, QString *error);
+    bool readTable(QSqlDatabase &db, std::vector<uint64_t> &ids,
+                   std::vector<CounterManager::Value> &values, QString *error);
+    bool write(const CounterManager &manager, int maxWrites,
+               SaveStats *stats, QString *error, const Progress &progress);
+    void mergeWritten(const std::vector<uint64_t> &ids, const std::vector<CounterManager::Value> &values,
+                      const std::function<bool(uint64_t)> &written);
+
+    QString connectionName_;
+    std::unique_ptr<Statements> statements_;
+
+    // Table contents after the last successful load/save, ordered by id.
+    bool synced_ = false;
+    std::vector<uint64_t> savedIds_;
+    std::vector<CounterManager::Value> savedValues_;
+    // Id where the last bounded write stopped; 0 after a complete write.
+    uint64_t resumeId_ = 0;
+    // Set by a failed load; saves are refused until a load succeeds or
+    // invalidate() is called.
+    bool loadFailed_ = false;
+};
+
+#endif // COUNTERSTORE_H
@@ -0,0 +1,150 @@
+#include "countertablemodel.h"
+
+#include <algorithm>
+
+CounterTableModel::CounterTableModel(CounterManager &manager, QObject *parent)
+    : QAbstractTableModel(parent),
+      manager_(manager),
+      rows_(manager.count()) {
+}
+
+int CounterTableModel::rowCount(const QModelIndex &parent) const {
+    return parent.isValid() ? 0 : rows_;
+}
+
+int CounterTableModel::columnCount(const QModelIndex &parent) const {
+    if (parent.isValid()) return 0;
+    return rates_ ? 2 : 1;
+}
+
+QVariant CounterTableModel::data(const QModelIndex &index, int role) const {
+    if ((role != Qt::DisplayRole && role != Qt::EditRole) || !index.isValid() || index.row() >= rows_) {
+        return QVariant();
+    }
+
+    if (index.column() == RateColumn) {
+        double rate = 0;
+        if (role != Qt::DisplayRole || !rates_ || !rates_->rowRate(index.row(), &rate)) return QVariant();
+        return QString::number(rate, 'f', 1);
+    }
+
+    const int offset = index.row() - windowFirst_;
+    if (offset >= 0 && offset < static_cast<int>(window_.size())) {
+        return static_cast<qlonglong>(window_[offset]);
+    }
+    // Scrolled outside the cached window; the next refresh() moves it here.
+    return static_cast<qlonglong>(manager_.counterAt(index.row()));
+}
+
+QVariant CounterTableModel::headerData(int section, Qt::Orientation orientation, int role) const {
+    if (role != Qt::DisplayRole) return QVariant();
+    if (orientation == Qt::Horizontal) {
+        return section == RateColumn ? QStringLiteral("Rate (Hz)") : QStringLiteral("Value");
+    }
+    return section + 1;
+}
+
+Qt::ItemFlags CounterTableModel::flags(const QModelIndex &index) const {
+    const bool editable = index.isValid() && index.column() == ValueColumn;
+    return QAbstractTableModel::flags(index) | (editable ? Qt::ItemIsEditable : Qt::NoItemFlags);
+}
+
+bool CounterTableModel::setData(const QModelIndex &index, const QVariant &value, int role) {
+    if (role != Qt::EditRole || !index.isValid() || index.column() != ValueColumn || index.row() >= rows_) {
+        return false;
+    }
+    bool ok = false;
+    const CounterManager::Value counter = value.toLongLong(&ok);
+    if (!ok) return false;
+
+    if (!manager_.setByHandle(handleAt(index.row()), counter)) return false;
+    // The next refresh() picks the row up through changesSince().
+    emit dataChanged(index, index, {Qt::DisplayRole, Qt::EditRole});
+    return true;
+}
+
+void CounterTableModel::setRateEstimator(RateEstimator *estimator) {
+    beginResetModel();
+    rates_ = estimator;
+    window_.clear();
+    windowHandles_.clear();
+    endResetModel();
+}
+
+CounterManager::Handle CounterTableModel::handleAt(int row) const {
+    const int offset = row - windowFirst_;
+    if (offset >= 0 && offset < static_cast<int>(windowHandles_.size())) {
+        return windowHandles_[offset];
+    }
+    return manager_.handleAt(row);
+}
+
+void CounterTableModel::addCounter(CounterManager::Value value) {
+    beginInsertRows(QModelIndex(), rows_, rows_);
+    manager_.addCounter(value);
+    rows_ = manager_.count();
+    window_.clear();
+    windowHandles_.clear();
+    endInsertRows();
+}
+
+int CounterTableModel::removeCounter(CounterManager::Handle handle) {
+    const int row = manager_.rowOf(handle);
+    if (row < 0 || row >= rows_) return -1;
+    beginRemoveRows(QModelIndex(), row, row);
+    manager_.deleteByHandle(handle);
+    rows_ = manager_.count();
+    window_.clear();
+    windowHandles_.clear();
+    endRemoveRows();
+    return row;
+}
+
+void CounterTableModel::reload() {
+    beginResetModel();
+    rows_ = manager_.count();
+    window_.clear();
+    windowHandles_.clear();
+    endResetModel();
+}
+
+void CounterTableModel::refresh(int firstRow, int lastRow) {
+    if (manager_.count() != rows_) {
+        // Only happens if someone edits the manager behind the model's back.
+        reload();
+        return;
+    }
+
+    lastRow = std::min(lastRow, rows_ - 1);
+    if (firstRow < 0 || firstRow > lastRow) return;
+
+    const int count = lastRow - firstRow + 1;
+    if (rates_) {
+        rates_->watchRows(firstRow, count);
+        // Rates move with every sample, so the column is always stale.
+        emit dataChanged(index(firstRow, RateColumn), index(lastRow, RateColumn), {Qt::DisplayRole});
+    }
+
+    CounterManager::Changes changes = manager_.changesSince(changeToken_, firstRow, count);
+    changeToken_ = changes.token;
+
+    const bool windowMoved = firstRow != windowFirst_ || count != static_cast<int>(window_.size());
+    if (!windowMoved && !changes.all && changes.rows.empty()) return;
+
+    windowFirst_ = firstRow;
+    window_ = manager_.getRange(firstRow, count, &windowHandles_);
+    if (windowMoved || changes.all) {
+        emit dataChanged(index(firstRow, 0), index(lastRow, 0), {Qt::DisplayRole});
+        return;
+    }
+
+    // Announce contiguous runs of changed rows.
+    std::size_t runStart = 0;
+    for (std::size_t i = 1; i <= changes.rows.size(); ++i) {
+        if (i == changes.rows.size() || changes.rows[i] != changes.rows[i - 1] + 1) {
+            emit dataChanged(index(changes.rows[runStart], 0), index(changes.rows[i - 1], 0),
+                             {Qt::DisplayRole});
+            runStart = i;
+        }
+    }
+}
@@ -0,0 +1,70 @@
+#ifndef COUNTERTABLEMODEL_H
+#define COUNTERTABLEMODEL_H
+
+#include "countermanager.h"
+#include "rateestimator.h"
+
+#include <QAbstractTableModel>
+
+#include <vector>
+
+// Table over a CounterManager whose values can be edited in place. Only the
+// window of rows the view currently shows is copied and announced on
+// refresh(), so a refresh costs O(visible rows) no matter how many counters
+// exist. Rows outside the window are fetched one by one when the view asks
+// for them. The optional Rate column shows per-counter rates from a
+// RateEstimator that watches the same window.
+class CounterTableModel : public QAbstractTableModel {
+    Q_OBJECT
+
+public:
+    explicit CounterTableModel(CounterManager &manager, QObject *parent = nullptr);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation,
+                        int role = Qt::DisplayRole) const override;
+    Qt::ItemFlags flags(const QModelIndex &index) const override;
+    bool setData(const QModelIndex &index, const QVariant &value, int role = Qt::EditRole) override;
+
+    enum Column { ValueColumn, RateColumn };
+
+    // Adds the Rate column; the estimator must outlive the model.
+    void setRateEstimator(RateEstimator *estimator);
+
+    // Handle of the counter shown in `row`, taken from the cached window
+    // when possible so it names what the view displayed. kNullHandle if the
+    // row does not exist.
+    CounterManager::Handle handleAt(int row) const;
+
+    // Structural edits go through the model so views keep their selection.
+    void addCounter(CounterManager::Value value);
+    // Removes the counter by handle, so a row that moved since it was shown
+    // still deletes the right counter. Returns the row it had, or -1 if the
+    // handle is stale.
+    int removeCounter(CounterManager::Handle handle);
+    // Call after replacing all counters (e.g. after loading).
+    void reload();
+
+    // Re-reads rows [firstRow, lastRow] and emits dataChanged for the rows
+    // that changed since the previous refresh (all of them if the window
+    // moved or the counters were incremented in bulk). The Rate column of
+    // the window is announced every time.
+    void refresh(int firstRow, int lastRow);
+
+private:
+    CounterManager &manager_;
+    RateEstimator *rates_ = nullptr;
+    int rows_ = 0;
+    // CounterManager::changesSince() token of the previous refresh.
+    uint64_t changeToken_ = 0;
+
+    // Cached values and handles of the visible window starting at
+    // windowFirst_.
+    int windowFirst_ = 0;
+    std::vector<CounterManager::Value> window_;
+    std::vector<CounterManager::Handle> windowHandles_;
+};
+
+#endif // COUNTERTABLEMODEL_H
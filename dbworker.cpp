@@ -0,0 +1,230 @@
+#include "dbworker.h"
+#include "counterstore.h"
+#include "chunkedcounterstore.h"
+#include "mappedcounterstore.h"
+
+#include <QTimer>
+
+#include <algorithm>
+#include <limits>
+
+namespace {
+
+// How often autosave triggers are evaluated and the budget refilled.
+constexpr int kAutosavePollMs = 100;
+
+// Journal compaction is checked this often, and forced once the segments
+// hold this many bytes regardless of the interval.
+constexpr int kCompactPollMs = 1000;
+constexpr qint64 kCompactJournalBytes = 16 * 1024 * 1024;
+
+} // namespace
+
+DbWorker::DbWorker(CounterManager &manager, Backend backend, const QString &path, QObject *parent)
+    : QObject(parent),
+      manager_(manager),
+      backend_(backend),
+      path_(path) {
+}
+
+DbWorker::~DbWorker() {
+    if (journalActive_) {
+        manager_.setObserver(nullptr);
+        // Final snapshot, so increments made since the last one survive too.
+        journal_->compact(manager_);
+        journal_->close();
+    }
+
+    // SQL stores hold prepared statements on the connection.
+    store_.reset();
+    connections_.reset();
+}
+
+void DbWorker::setIncrementSource(std::function<uint64_t()> source) {
+    incrementSource_ = std::move(source);
+}
+
+void DbWorker::enableJournal(const QString &directory, int compactIntervalMs) {
+    journal_ = std::make_unique<CounterJournal>(directory);
+    journalCompactMs_ = std::max(0, compactIntervalMs);
+}
+
+void DbWorker::setSqliteProfile(const SqliteProfile &profile) {
+    sqliteProfile_ = profile;
+}
+
+void DbWorker::load() {
+    QString error;
+    bool ok = journal_ ? loadFromJournal(&error)
+                       : run([this](QString *e) { return store_->load(manager_, e); }, &error);
+    loaded_ = ok;
+    emit loaded(ok, error);
+}
+
+bool DbWorker::loadFromJournal(QString *error) {
+    std::vector<uint64_t> ids;
+    std::vector<CounterManager::Value> values;
+    if (journal_->recover(ids, values, error)) {
+        if (!open(error)) return false;
+        manager_.setCounters(values, ids);
+        // The database may lag behind the journal; diff everything on the
+        // next save.
+        store_->invalidate();
+    } else if (!error->isEmpty()) {
+        return false;
+    } else if (!run([this](QString *e) { return store_->load(manager_, e); }, error)
+               || !journal_->compact(manager_, error)) {
+        // First run with a journal: the database is the baseline.
+        return false;
+    }
+
+    if (!journal_->open(error)) return false;
+    manager_.setObserver(journal_.get());
+    journalActive_ = true;
+
+    sinceCompact_.start();
+    if (!compactTimer_) {
+        compactTimer_ = new QTimer(this);
+        connect(compactTimer_, &QTimer::timeout, this, &DbWorker::onCompactTimer);
+    }
+    compactTimer_->start(kCompactPollMs);
+    return true;
+}
+
+void DbWorker::save() {
+    QString error;
+    CounterBackend::SaveStats stats;
+    if (!loaded_) {
+        emit saved(false, "Not saving: the counters have not been loaded", 0, 0, 0);
+        return;
+    }
+    bool ok = run([&](QString *e) {
+        return store_->save(manager_, &stats, e, [this](int done, int total) {
+            emit saveProgress(done, total);
+        });
+    }, &error);
+    emit saved(ok, error, stats.inserted, stats.updated, stats.deleted);
+}
+
+void DbWorker::startAutosave(int intervalMs, qulonglong incrementThreshold, qint64 rowsPerSecond) {
+    autosaveIntervalMs_ = std::max(0, intervalMs);
+    autosaveIncrements_ = incrementSource_ ? incrementThreshold : 0;
+    autosaveBudget_ = std::max<qint64>(0, rowsPerSecond);
+    autosaveTokens_ = static_cast<double>(autosaveBudget_);
+
+    if (autosaveIntervalMs_ == 0 && autosaveIncrements_ == 0) {
+        delete autosaveTimer_;
+        autosaveTimer_ = nullptr;
+        return;
+    }
+
+    sinceRefill_.start();
+    sinceCheckpoint_.start();
+    incrementsAtCheckpoint_ = incrementSource_ ? incrementSource_() : 0;
+    if (!autosaveTimer_) {
+        autosaveTimer_ = new QTimer(this);
+        connect(autosaveTimer_, &QTimer::timeout, this, &DbWorker::onAutosaveTimer);
+    }
+    autosaveTimer_->start(kAutosavePollMs);
+}
+
+void DbWorker::onAutosaveTimer() {
+    if (!loaded_) return;
+    if (autosaveBudget_ > 0) {
+        const double seconds = sinceRefill_.restart() / 1000.0;
+        autosaveTokens_ = std::min<double>(autosaveBudget_, autosaveTokens_ + autosaveBudget_ * seconds);
+    }
+
+    const uint64_t increments = incrementSource_ ? incrementSource_() : 0;
+    const bool due = checkpointPending_
+                     || (autosaveIntervalMs_ > 0 && sinceCheckpoint_.elapsed() >= autosaveIntervalMs_)
+                     || (autosaveIncrements_ > 0 && increments - incrementsAtCheckpoint_ >= autosaveIncrements_);
+    if (!due) return;
+
+    int maxWrites = std::numeric_limits<int>::max();
+    if (autosaveBudget_ > 0) {
+        maxWrites = static_cast<int>(std::min<double>(maxWrites, autosaveTokens_));
+        if (maxWrites < 1) {
+            checkpointPending_ = true;
+            return;
+        }
+    }
+
+    QString error;
+    CounterBackend::SaveStats stats;
+    QElapsedTimer duration;
+    duration.start();
+    bool ok = run([&](QString *e) { return store_->checkpoint(manager_, maxWrites, &stats, e); }, &error);
+    const double durationMs = duration.nsecsElapsed() / 1e6;
+
+    autosaveTokens_ -= stats.rows;
+    // An incomplete checkpoint continues on the next poll with fresh budget.
+    checkpointPending_ = ok && !stats.complete;
+    if (!checkpointPending_) {
+        sinceCheckpoint_.restart();
+        incrementsAtCheckpoint_ = increments;
+    }
+    emit checkpointed(ok, error, durationMs, stats.rows, stats.complete);
+}
+
+void DbWorker::onCompactTimer() {
+    QString error;
+    const bool failed = journal_->failed(&error);
+    if (failed && !journalFailed_) {
+        qWarning("Journal stopped recording edits: %s", qPrintable(error));
+    }
+    journalFailed_ = failed;
+
+    // A compaction covers the edits a failed journal lost and resumes it.
+    const bool due = failed
+                     || (journalCompactMs_ > 0 && sinceCompact_.elapsed() >= journalCompactMs_)
+                     || journal_->journalBytes() >= kCompactJournalBytes;
+    if (due) compactJournal();
+}
+
+void DbWorker::compactJournal() {
+    if (!journalActive_) return;
+    QString error;
+    if (!journal_->compact(manager_, &error)) {
+        qWarning("Journal compaction failed: %s", qPrintable(error));
+    }
+    sinceCompact_.restart();
+}
+
+// The connection is opened lazily so that it belongs to the worker thread,
+// and lives as long as the worker so prepared statements stay cached.
+bool DbWorker::open(QString *error) {
+    if (backend_ == Backend::Mapped) {
+        if (!store_) {
+            store_ = std::make_unique<MappedCounterStore>(path_);
+        }
+        return true;
+    }
+
+    if (!connections_) {
+        connections_ = std::make_unique<ConnectionManager>(path_, sqliteProfile_);
+    }
+    const QString connection = connections_->acquire(error);
+    if (connection.isEmpty()) return false;
+
+    // The name survives reconnects, so the store is created only once.
+    if (!store_) {
+        if (backend_ == Backend::SqliteChunked) {
+            store_ = std::make_unique<ChunkedCounterStore>(connection);
+        } else {
+            store_ = std::make_unique<CounterStore>(connection);
+        }
+    }
+    return true;
+}
+
+bool DbWorker::run(const std::function<bool(QString *)> &operation, QString *error) {
+    if (open(error) && operation(error)) return true;
+    if (backend_ == Backend::Mapped || !connections_) return false;
+
+    qWarning("Database operation failed, reconnecting: %s", qPrintable(*error));
+    if (store_) store_->releaseConnection();
+    connections_->reconnect();
+    error->clear();
+    return open(error) && operation(error);
+}
@@ -0,0 +1,119 @@
+#ifndef DBWORKER_H
+#define DBWORKER_H
+
+#include "countermanager.h"
+#include "counterbackend.h"
+#include "counterjournal.h"
+#include "sqliteprofile.h"
+#include "connectionmanager.h"
+
+#include <QObject>
+#include <QString>
+#include <QElapsedTimer>
+
+#include <memory>
+#include <functional>
+#include <cstdint>
+
+class QTimer;
+
+// Runs counter persistence on its own thread with its own long-lived
+// SQLite connection or mapped file. Move it to a QThread and call the slots
+// through queued connections; results come back as signals.
+class DbWorker : public QObject {
+    Q_OBJECT
+
+public:
+    enum class Backend {
+        // `counters` table in a SQLite database (CounterStore).
+        Sqlite,
+        // `counter_chunks` BLOB table in a SQLite database
+        // (ChunkedCounterStore).
+        SqliteChunked,
+        // Memory-mapped binary file (MappedCounterStore).
+        Mapped
+    };
+
+    DbWorker(CounterManager &manager, Backend backend, const QString &path, QObject *parent = nullptr);
+    ~DbWorker();
+
+    // Cumulative increment count used by the "every M increments" autosave
+    // trigger. Must be callable from the worker thread.
+    void setIncrementSource(std::function<uint64_t()> source);
+
+    // Journals single-counter edits to `directory` and recovers from it on
+    // load() instead of reading the database. The journal is compacted into
+    // a snapshot every compactIntervalMs and whenever it grows large. Call
+    // before the worker thread starts.
+    void enableJournal(const QString &directory, int compactIntervalMs);
+
+    // PRAGMAs applied when the SQLite connection opens. Call before the
+    // worker thread starts.
+    void setSqliteProfile(const SqliteProfile &profile);
+
+public slots:
+    void load();
+    void save();
+    // Snapshots the journal now, e.g. after bulk edits it does not record.
+    // Does nothing without an active journal.
+    void compactJournal();
+
+    // Checkpoints every intervalMs milliseconds and/or every
+    // incrementThreshold increments (0 disables a trigger). Checkpoints only
+    // write deltas and are spread out so they write at most about
+    // rowsPerSecond counter rows per second (0 means unlimited). The budget
+    // counts rows, not bytes of I/O; what a row costs on disk depends on
+    // the backend and its page and journal overhead.
+    void startAutosave(int intervalMs, qulonglong incrementThreshold, qint64 rowsPerSecond);
+
+signals:
+    void loaded(bool ok, const QString &error);
+    void saveProgress(int done, int total);
+    void saved(bool ok, const QString &error, int inserted, int updated, int deleted);
+    void checkpointed(bool ok, const QString &error, double durationMs, qint64 rows, bool complete);
+
+private:
+    bool open(QString *error);
+    // Runs a store operation; on failure of an SQL backend the connection
+    // is reopened and the operation retried once.
+    bool run(const std::function<bool(QString *)> &operation, QString *error);
+    void onAutosaveTimer();
+    bool loadFromJournal(QString *error);
+    void onCompactTimer();
+
+    CounterManager &manager_;
+    const Backend backend_;
+    const QString path_;
+    SqliteProfile sqliteProfile_ = SqliteProfile::defaults();
+    // Declared before store_ so statements die before their connection.
+    std::unique_ptr<ConnectionManager> connections_;
+    std::unique_ptr<CounterBackend> store_;
+
+    // Set only by a successful load. Until then the manager does not hold
+    // what the store does, and a save would replace the stored counters.
+    bool loaded_ = false;
+
+    std::function<uint64_t()> incrementSource_;
+    QTimer *autosaveTimer_ = nullptr;
+    int autosaveIntervalMs_ = 0;
+    uint64_t autosaveIncrements_ = 0;
+    qint64 autosaveBudget_ = 0;
+    // Token bucket of counter rows, refilled at autosaveBudget_ per second
+    // and capped at one second worth.
+    double autosaveTokens_ = 0;
+    QElapsedTimer sinceRefill_;
+    QElapsedTimer sinceCheckpoint_;
+    uint64_t incrementsAtCheckpoint_ = 0;
+    bool checkpointPending_ = false;
+
+    std::unique_ptr<CounterJournal> journal_;
+    // Set once the journal is recovered and attached to the manager.
+    bool journalActive_ = false;
+    // Last failed() state seen, so each failure is reported once.
+    bool journalFailed_ = false;
+    int journalCompactMs_ = 0;
+    QTimer *compactTimer_ = nullptr;
+    QElapsedTimer sinceCompact_;
+};
+
+#endif // DBWORKER_H
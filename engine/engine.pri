@@ -0,0 +1,15 @@
+# Include from a project one level below the root to link the static
+# engine library built by engine/engine.pro.
+QT += core sql
+CONFIG += c++17
+CONFIG -= debug_and_release
+
+INCLUDEPATH += $$PWD/..
+
+ENGINE_OUT = $$OUT_PWD/../engine
+LIBS += -L$$ENGINE_OUT -lcounterengine
+win32-msvc* {
+    PRE_TARGETDEPS += $$ENGINE_OUT/counterengine.lib
+} else {
+    PRE_TARGETDEPS += $$ENGINE_OUT/libcounterengine.a
+}
@@ -0,0 +1,47 @@
+# Counter engine, tick scheduler, rate sampler and persistence as a static
+# library with no GUI dependency. The sources live in the repository root.
+TEMPLATE = lib
+CONFIG += staticlib c++17
+CONFIG -= debug_and_release
+
+QT = core sql
+
+TARGET = counterengine
+
+INCLUDEPATH += ..
+
+SOURCES += \
+    ../countermanager.cpp \
+    ../slotindex.cpp \
+    ../counterkernels.cpp \
+    ../counterengine.cpp \
+    ../tickscheduler.cpp \
+    ../rateestimator.cpp \
+    ../counterstore.cpp \
+    ../chunkedcounterstore.cpp \
+    ../mappedcounterstore.cpp \
+    ../dbworker.cpp \
+    ../counterjournal.cpp \
+    ../sqliteprofile.cpp \
+    ../connectionmanager.cpp \
+    ../counterservice.cpp \
+    ../engineoptions.cpp
+
+HEADERS += \
+    ../countermanager.h \
+    ../slotindex.h \
+    ../counterkernels.h \
+    ../counterengine.h \
+    ../tickscheduler.h \
+    ../rateestimator.h \
+    ../counterbackend.h \
+    ../counterstore.h \
+    ../chunkedcounterstore.h \
+    ../mappedcounterstore.h \
+    ../dbworker.h \
+    ../counterjournal.h \
+    ../sqliteprofile.h \
+    ../connectionmanager.h \
+    ../counterservice.h \
+    ../engineconfig.h \
+    ../engineoptions.h
@@ -0,0 +1,47 @@
+#ifndef ENGINECONFIG_H
+#define ENGINECONFIG_H
+
+#include "countermanager.h"
+#include "tickscheduler.h"
+#include "dbworker.h"
+#include "sqliteprofile.h"
+
+#include <QString>
+
+// Startup options for the counter engine, filled from the command line.
+struct EngineConfig {
+    CounterManager::StorageMode storageMode = CounterManager::StorageMode::Locked;
+    // Number of cache-line aligned partitions of the counter array.
+    int shardCount = 1;
+    // Worker threads sharing the shards; clamped to shardCount.
+    int threadCount = 1;
+    // Increment ticks per second per worker, clamped to 1 Hz .. 100 kHz.
+    double tickRateHz = 1000.0;
+    TickScheduler::CatchUp catchUp = TickScheduler::CatchUp::Burst;
+    TickScheduler::WaitMode waitMode = TickScheduler::WaitMode::Sleep;
+    // Start without pacing, incrementing as fast as the hardware allows.
+    bool freeRunning = false;
+    // First CPU core to pin workers to (worker i gets pinCore + i), or -1
+    // to leave placement to the OS. Only honoured on Linux.
+    int pinCore = -1;
+
+    // Where counters are persisted: counters.db (per-row or chunked) or
+    // counters.bin.
+    DbWorker::Backend storeBackend = DbWorker::Backend::Sqlite;
+    // PRAGMA preset for the SQLite backends.
+    SqliteProfile sqliteProfile = SqliteProfile::balanced();
+
+    // Autosave checkpoints: every N seconds and/or every M increments
+    // (0 disables the trigger), limited to a write budget in counter rows
+    // per second (0 means unlimited).
+    int autosaveIntervalSec = 0;
+    qulonglong autosaveIncrements = 0;
+    qint64 autosaveRowsPerSec = 0;
+
+    // Directory of the mutation journal, empty to disable it, and how
+    // often the journal is compacted into a snapshot.
+    QString journalDirectory;
+    int journalCompactSec = 60;
+};
+
+#endif // ENGINECONFIG_H
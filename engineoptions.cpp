@@ -0,0 +1,125 @@
+#include "engineoptions.h"
+
+#include <QCommandLineParser>
+
+#include <algorithm>
+
+namespace EngineOptions {
+
+void add(QCommandLineParser &parser) {
+    QCommandLineOption storageOption("storage",
+                                     "Counter storage mode: locked or atomic.",
+                                     "mode", "locked");
+    parser.addOption(storageOption);
+    QCommandLineOption shardsOption("shards",
+                                    "Number of counter shards.",
+                                    "count", "1");
+    parser.addOption(shardsOption);
+    QCommandLineOption threadsOption("threads",
+                                     "Number of increment worker threads.",
+                                     "count", "1");
+    parser.addOption(threadsOption);
+    QCommandLineOption rateOption("rate",
+                                  "Increment ticks per second, 1 to 100000.",
+                                  "hz", "1000");
+    parser.addOption(rateOption);
+    QCommandLineOption waitOption("wait",
+                                  "Tick wait strategy: sleep, hybrid or spin.",
+                                  "mode", "sleep");
+    parser.addOption(waitOption);
+    QCommandLineOption catchUpOption("catch-up",
+                                     "Late tick policy: burst or skip.",
+                                     "policy", "burst");
+    parser.addOption(catchUpOption);
+    QCommandLineOption maxThroughputOption("max-throughput",
+                                           "Start incrementing without pacing.");
+    parser.addOption(maxThroughputOption);
+    QCommandLineOption pinCoreOption("pin-core",
+                                     "Pin worker i to CPU core N + i (Linux only).",
+                                     "core", "-1");
+    parser.addOption(pinCoreOption);
+    QCommandLineOption storeOption("store",
+                                   "Persistence backend: sqlite, chunked or mapped.",
+                                   "backend", "sqlite");
+    parser.addOption(storeOption);
+    QCommandLineOption sqliteProfileOption("sqlite-profile",
+                                           "SQLite tuning: " + SqliteProfile::names().join(", ") + ".",
+                                           "profile", "balanced");
+    parser.addOption(sqliteProfileOption);
+    QCommandLineOption autosaveIntervalOption("autosave-interval",
+                                              "Checkpoint every N seconds (0 disables).",
+                                              "seconds", "0");
+    parser.addOption(autosaveIntervalOption);
+    QCommandLineOption autosaveIncrementsOption("autosave-increments",
+                                                "Checkpoint every M counter increments (0 disables).",
+                                                "count", "0");
+    parser.addOption(autosaveIncrementsOption);
+    QCommandLineOption autosaveBudgetOption("autosave-row-budget",
+                                            "Autosave write budget in counter rows per second (0 is unlimited).",
+                                            "rows", "0");
+    parser.addOption(autosaveBudgetOption);
+    QCommandLineOption journalOption("journal",
+                                     "Journal counter edits to DIR and recover from it on start.",
+                                     "dir");
+    parser.addOption(journalOption);
+    QCommandLineOption journalCompactOption("journal-compact",
+                                            "Compact the journal every N seconds.",
+                                            "seconds", "60");
+    parser.addOption(journalCompactOption);
+}
+
+EngineConfig parse(const QCommandLineParser &parser) {
+    EngineConfig config;
+    const QString storage = parser.value("storage");
+    if (storage == "atomic") {
+        config.storageMode = CounterManager::StorageMode::Atomic;
+    } else if (storage != "locked") {
+        qWarning("Unknown storage mode '%s', using locked", qPrintable(storage));
+    }
+
+    const QString store = parser.value("store");
+    if (store == "mapped") {
+        config.storeBackend = DbWorker::Backend::Mapped;
+    } else if (store == "chunked") {
+        config.storeBackend = DbWorker::Backend::SqliteChunked;
+    } else if (store != "sqlite") {
+        qWarning("Unknown store backend '%s', using sqlite", qPrintable(store));
+    }
+
+    const QString sqliteProfile = parser.value("sqlite-profile");
+    if (!SqliteProfile::fromName(sqliteProfile, &config.sqliteProfile)) {
+        qWarning("Unknown SQLite profile '%s', using balanced", qPrintable(sqliteProfile));
+    }
+
+    config.shardCount = std::max(1, parser.value("shards").toInt());
+    config.threadCount = std::max(1, parser.value("threads").toInt());
+    config.tickRateHz = parser.value("rate").toDouble();
+
+    config.freeRunning = parser.isSet("max-throughput");
+    config.pinCore = parser.value("pin-core").toInt();
+    config.autosaveIntervalSec = std::max(0, parser.value("autosave-interval").toInt());
+    config.autosaveIncrements = parser.value("autosave-increments").toULongLong();
+    config.autosaveRowsPerSec = std::max<qint64>(0, parser.value("autosave-row-budget").toLongLong());
+    config.journalDirectory = parser.value("journal");
+    config.journalCompactSec = std::max(0, parser.value("journal-compact").toInt());
+
+    const QString wait = parser.value("wait");
+    if (wait == "hybrid") {
+        config.waitMode = TickScheduler::WaitMode::Hybrid;
+    } else if (wait == "spin") {
+        config.waitMode = TickScheduler::WaitMode::Spin;
+    } else if (wait != "sleep") {
+        qWarning("Unknown wait mode '%s', using sleep", qPrintable(wait));
+    }
+
+    const QString catchUp = parser.value("catch-up");
+    if (catchUp == "skip") {
+        config.catchUp = TickScheduler::CatchUp::Skip;
+    } else if (catchUp != "burst") {
+        qWarning("Unknown catch-up policy '%s', using burst", qPrintable(catchUp));
+    }
+
+    return config;
+}
+
+} // namespace EngineOptions
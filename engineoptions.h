@@ -0,0 +1,20 @@
+#ifndef ENGINEOPTIONS_H
+#define ENGINEOPTIONS_H
+
+#include "engineconfig.h"
+
+class QCommandLineParser;
+
+// Command line options of the counter engine, shared by the GUI and the
+// headless driver.
+namespace EngineOptions {
+
+void add(QCommandLineParser &parser);
+
+// Reads the options added by add() from a processed parser. Unknown enum
+// values fall back to their defaults with a warning.
+EngineConfig parse(const QCommandLineParser &parser);
+
+} // namespace EngineOptions
+
+#endif // ENGINEOPTIONS_H
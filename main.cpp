@@ -1,10 +1,20 @@
 #include "mainwindow.h"
+#include "engineoptions.h"
 
 #include <QApplication>
+#include <QCommandLineParser>
 
 int main(int argc, char *argv[]) {
     QApplication a(argc, argv);
-    MainWindow w;
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    EngineOptions::add(parser);
+    parser.process(a);
+
+    const EngineConfig config = EngineOptions::parse(parser);
+
+    MainWindow w(config);
     w.show();
     return QApplication::exec();
 }
@@ -3,56 +3,27 @@
 #include <QHBoxLayout>
 #include <QVBoxLayout>
 #include <QHeaderView>
+#include <QScrollBar>
 #include <QMessageBox>
 #include <QScreen>
-#include <QSqlDatabase>
-#include <QSqlQuery>
+#include <QStatusBar>
 #include <QDateTime>
 #include <QTimer>
+#include <QStringList>
 
 #include <chrono>
 #include <atomic>
 
-void CounterManager::addCounter(int value) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    counters_.push_back(value);
-}
-
-void CounterManager::deleteCounter(int index) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    if (index >= 0 && index < static_cast<int>(counters_.size())) {
-        counters_.erase(counters_.begin() + index);
-    }
-}
-
-std::vector<int> CounterManager::getCounters() const {
-    std::lock_guard<std::mutex> lock(mutex_);
-    return counters_;
-}
-
-void CounterManager::incrementAll() {
-    std::lock_guard<std::mutex> lock(mutex_);
-    for (auto& counter : counters_) {
-        ++counter;
-    }
-}
-
-void CounterManager::setCounters(const std::vector<int>& counters) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    counters_ = counters;
-}
-
-MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent) {
+MainWindow::MainWindow(const EngineConfig &config, QWidget *parent)
+    : QMainWindow(parent), service(config) {
     setupUI();
-    loadCountersFromDatabase();
-    adjustWindowSize();
 
-    workerThread = std::thread([this]() {
-        while (keepRunning.load()) {
-            counterManager.incrementAll();
-            std::this_thread::sleep_for(std::chrono::milliseconds(1));
-        }
-    });
+    connect(&service, &CounterService::loaded, this, &MainWindow::onCountersLoaded);
+    connect(&service, &CounterService::saveProgress, this, &MainWindow::onSaveProgress);
+    connect(&service, &CounterService::saved, this, &MainWindow::onCountersSaved);
+    connect(&service, &CounterService::checkpointed, this, &MainWindow::onCheckpointed);
+    service.start();
+    adjustWindowSize();
 
     tableTimer = new QTimer(this);
     connect(tableTimer, &QTimer::timeout, this, &MainWindow::updateTable);
@@ -64,35 +35,61 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent) {
 }
 
 MainWindow::~MainWindow() {
-    keepRunning.store(false);
-
-    if (workerThread.joinable()) {
-        workerThread.join();
-    }
-    QSqlDatabase::database().close();
+    service.stop();
 }
 
 void MainWindow::setupUI() {
-    tableWidget = new QTableWidget(this);
-    tableWidget->setColumnCount(1);
-    tableWidget->setHorizontalHeaderLabels({"Value"});
-    tableWidget->horizontalHeader()->setStretchLastSection(true);
+    tableModel = new CounterTableModel(service.manager(), this);
+    tableModel->setRateEstimator(&service.rates());
+    tableView = new QTableView(this);
+    tableView->setModel(tableModel);
+    tableView->setSelectionBehavior(QAbstractItemView::SelectRows);
+    tableView->setSelectionMode(QAbstractItemView::SingleSelection);
+    tableView->horizontalHeader()->setStretchLastSection(true);
+    // Fixed row height lets the view skip measuring every row.
+    tableView->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+    // Move the cached window along with the viewport instead of waiting
+    // for the next refresh tick.
+    connect(tableView->verticalScrollBar(), &QScrollBar::valueChanged, this, &MainWindow::updateTable);
 
     addButton = new QPushButton("Add", this);
     deleteButton = new QPushButton("Delete", this);
     saveButton = new QPushButton("Save", this);
+    // The load is queued to the persistence thread and replaces all
+    // counters when it lands; edits before that would be lost, and a save
+    // would overwrite the store with nothing.
+    addButton->setEnabled(false);
+    deleteButton->setEnabled(false);
+    saveButton->setEnabled(false);
+    maxThroughputBox = new QCheckBox("Max throughput", this);
+    maxThroughputBox->setChecked(service.engine().isFreeRunning());
+    pauseBox = new QCheckBox("Pause", this);
     freqLabel = new QLabel("Frequency: 0 Hz", this);
+    shardLabel = new QLabel(this);
+    shardLabel->setWordWrap(true);
+    shardLabel->setVisible(service.engine().shardCount() > 1);
+    tickLabel = new QLabel(this);
+    saveProgressBar = new QProgressBar(this);
+    saveProgressBar->setMaximumWidth(200);
+    saveProgressBar->hide();
+    statusBar()->addPermanentWidget(saveProgressBar);
+    checkpointLabel = new QLabel(this);
+    statusBar()->addPermanentWidget(checkpointLabel);
 
     QVBoxLayout *layout = new QVBoxLayout;
-    layout->addWidget(tableWidget);
+    layout->addWidget(tableView);
 
     QHBoxLayout *buttonLayout = new QHBoxLayout;
     buttonLayout->addWidget(addButton);
     buttonLayout->addWidget(deleteButton);
     buttonLayout->addWidget(saveButton);
+    buttonLayout->addWidget(maxThroughputBox);
+    buttonLayout->addWidget(pauseBox);
 
     layout->addLayout(buttonLayout);
     layout->addWidget(freqLabel);
+    layout->addWidget(shardLabel);
+    layout->addWidget(tickLabel);
 
     QWidget *centralWidget = new QWidget(this);
     centralWidget->setLayout(layout);
@@ -101,12 +98,14 @@ void MainWindow::setupUI() {
     connect(addButton, &QPushButton::clicked, this, &MainWindow::onAddClicked);
     connect(deleteButton, &QPushButton::clicked, this, &MainWindow::onDeleteClicked);
     connect(saveButton, &QPushButton::clicked, this, &MainWindow::onSaveClicked);
+    connect(maxThroughputBox, &QCheckBox::toggled, this, &MainWindow::onMaxThroughputToggled);
+    connect(pauseBox, &QCheckBox::toggled, this, &MainWindow::onPauseToggled);
 }
 
 void MainWindow::adjustWindowSize() {
-    int rowHeight = tableWidget->rowHeight(0);
-    int headerHeight = tableWidget->horizontalHeader()->height();
-    int totalTableHeight = rowHeight * tableWidget->rowCount() + headerHeight;
+    int rowHeight = tableView->verticalHeader()->defaultSectionSize();
+    int headerHeight = tableView->horizontalHeader()->height();
+    int totalTableHeight = rowHeight * tableModel->rowCount() + headerHeight;
 
     int extraHeight = 150;
     int totalHeight = totalTableHeight + extraHeight;
@@ -118,122 +117,159 @@ void MainWindow::adjustWindowSize() {
     int finalHeight = std::min(totalHeight, maxHeight);
 
     // Resize and recenter
-    resize(tableWidget->width(), finalHeight);
+    resize(tableView->width(), finalHeight);
     move(screenGeometry.center() - rect().center());
 }
 
-void MainWindow::loadCountersFromDatabase() {
-    QSqlDatabase db = QSqlDatabase::database();
-
-    if (!db.isValid()) {
-        db = QSqlDatabase::addDatabase("QSQLITE");
-        db.setDatabaseName("counters.db");
-    }
-
-    if (!db.open()) {
-        QMessageBox::critical(this, "Error", "Failed to open database");
-        return;
-    }
-
-    QSqlQuery query(db);
-    query.exec("CREATE TABLE IF NOT EXISTS counters (value INTEGER)");
-    query.exec("SELECT value FROM counters");
-
-    std::vector<int> counters;
-    while (query.next()) {
-        counters.push_back(query.value(0).toInt());
+void MainWindow::onCountersLoaded(bool ok, const QString &error) {
+    if (!ok) {
+        QMessageBox::critical(this, "Error", "Failed to load counters: " + error);
     }
-
-    counterManager.setCounters(counters);
-    tableWidget->setRowCount(static_cast<int>(counters.size()));
-    for (int i = 0; i < static_cast<int>(counters.size()); ++i) {
-        QTableWidgetItem *item = new QTableWidgetItem(QString::number(counters[i]));
-        tableWidget->setItem(i, 0, item);
-    }
-
-    db.close();
+    addButton->setEnabled(true);
+    deleteButton->setEnabled(true);
+    // Never save over a store that could not be read.
+    saveButton->setEnabled(ok);
+    tableModel->reload();
+    adjustWindowSize();
 }
 
 void MainWindow::onAddClicked() {
-    counterManager.addCounter(0);
-    int row = tableWidget->rowCount();
-    tableWidget->insertRow(row);
-    QTableWidgetItem *item = new QTableWidgetItem("0");
-    tableWidget->setItem(row, 0, item);
+    tableModel->addCounter(0);
     adjustWindowSize();
 }
 
 void MainWindow::onDeleteClicked() {
-    QList<QTableWidgetItem*> selected = tableWidget->selectedItems();
+    QModelIndexList selected = tableView->selectionModel()->selectedRows();
     if (selected.isEmpty()) return;
 
-    int row = selected.first()->row();
-    counterManager.deleteCounter(row);
-    tableWidget->removeRow(row);
+    // Resolve the row to a handle first: rows can shift under concurrent
+    // structural changes, the handle keeps naming the selected counter.
+    int row = tableModel->removeCounter(tableModel->handleAt(selected.first().row()));
+    if (row < 0) return;
 
     // Select the next row
-    int rowCount = tableWidget->rowCount();
+    int rowCount = tableModel->rowCount();
     if (rowCount > 0) {
         int nextRow = row;
         if (nextRow >= rowCount) {
             nextRow = rowCount - 1;
         }
-        tableWidget->selectRow(nextRow);
+        tableView->selectRow(nextRow);
     }
     adjustWindowSize();
 }
 
 void MainWindow::onSaveClicked() {
-    QSqlDatabase db = QSqlDatabase::database();
-    if (!db.isOpen()) {
-        QMessageBox::critical(this, "Error", "Database connection is not open");
+    saveButton->setEnabled(false);
+    saveProgressBar->setValue(0);
+    saveProgressBar->show();
+    service.save();
+}
+
+void MainWindow::onSaveProgress(int done, int total) {
+    saveProgressBar->setMaximum(total);
+    saveProgressBar->setValue(done);
+}
+
+void MainWindow::onCountersSaved(bool ok, const QString &error, int inserted, int updated, int deleted) {
+    saveButton->setEnabled(true);
+    saveProgressBar->hide();
+
+    if (!ok) {
+        QMessageBox::critical(this, "Error", "Failed to save counters: " + error);
         return;
     }
+    statusBar()->showMessage(QString("Saved: %1 inserted, %2 updated, %3 deleted")
+                                 .arg(inserted)
+                                 .arg(updated)
+                                 .arg(deleted), 5000);
+}
 
-    QSqlQuery query(db);
-    query.exec("BEGIN TRANSACTION");
-    query.exec("DELETE FROM counters");
-
-    std::vector<int> counters = counterManager.getCounters();
-    query.prepare("INSERT INTO counters (value) VALUES (?)");
-    for (int value : counters) {
-        query.bindValue(0, value);
-        query.exec();
+void MainWindow::onCheckpointed(bool ok, const QString &error, double durationMs, qint64 rows, bool complete) {
+    if (!ok) {
+        checkpointLabel->setText("Autosave failed: " + error);
+        return;
     }
 
-    query.exec("COMMIT");
+    ++checkpointCount;
+    checkpointRows += rows;
+    checkpointLabel->setText(QString("Autosave: %1 ms, %2 rows%3 (total %4 rows in %5)")
+                                 .arg(durationMs, 0, 'f', 1)
+                                 .arg(rows)
+                                 .arg(complete ? "" : ", partial")
+                                 .arg(checkpointRows)
+                                 .arg(checkpointCount));
+}
+
+void MainWindow::onMaxThroughputToggled(bool enabled) {
+    service.engine().setFreeRunning(enabled);
+}
+
+void MainWindow::onPauseToggled(bool paused) {
+    service.engine().setPaused(paused);
 }
 
 void MainWindow::updateTable() {
-    std::vector<int> counters = counterManager.getCounters();
-    tableWidget->setRowCount(static_cast<int>(counters.size()));
-
-    for (int i = 0; i < static_cast<int>(counters.size()); ++i) {
-        auto *item = tableWidget->item(i, 0);
-        if (!item) {
-            item = new QTableWidgetItem();
-            tableWidget->setItem(i, 0, item);
-        }
-        item->setText(QString::number(counters[i]));
+    // Only the rows inside the viewport need repainting.
+    int firstRow = tableView->rowAt(0);
+    if (firstRow < 0) {
+        tableModel->refresh(0, -1);
+        return;
     }
+    int lastRow = tableView->rowAt(tableView->viewport()->height() - 1);
+    if (lastRow < 0) {
+        lastRow = tableModel->rowCount() - 1;
+    }
+    tableModel->refresh(firstRow, lastRow);
 }
 
 void MainWindow::updateFrequency() {
-        std::vector<int> counters = counterManager.getCounters();
-        double currentSum = std::accumulate(counters.begin(), counters.end(), 0);
+        // Sampled on the estimator's thread; this only reads the results.
+        const RateEstimator::Rates total = service.rates().totalRates();
+        const RateEstimator::Rates perCounter = service.rates().tickRates();
+
+        std::vector<uint64_t> shardIncrements = service.engine().shardIncrements();
+        TickScheduler::Stats tickStats = service.engine().takeTickStats();
 
         if (!elapsedTimer.isValid()) {
             elapsedTimer.start();
-            previousSum = currentSum;
+            previousShardIncrements = shardIncrements;
             return;
         }
 
         double timeDiff = elapsedTimer.elapsed() / 1000.0;
         if (timeDiff <= 0) return;
 
-        double frequency = (currentSum - previousSum) / timeDiff;
-        freqLabel->setText(QString("Frequency: %1 Hz").arg(frequency, 0, 'f', 2));
+        freqLabel->setText(QString("Frequency: %1 Hz total (10 s: %2, 60 s: %3, EWMA: %4), %5 Hz per counter")
+                               .arg(total.window1s, 0, 'f', 2)
+                               .arg(total.window10s, 0, 'f', 2)
+                               .arg(total.window60s, 0, 'f', 2)
+                               .arg(total.ewma, 0, 'f', 2)
+                               .arg(perCounter.window1s, 0, 'f', 2));
+
+        if (shardIncrements.size() > 1) {
+            QStringList rates;
+            for (std::size_t shard = 0; shard < shardIncrements.size(); ++shard) {
+                double shardRate = (shardIncrements[shard] - previousShardIncrements[shard]) / timeDiff;
+                rates << QString("#%1: %2 Hz").arg(shard).arg(shardRate, 0, 'f', 0);
+            }
+            shardLabel->setText(QString("Shards (%1 threads): %2")
+                                    .arg(service.engine().threadCount())
+                                    .arg(rates.join(", ")));
+        }
+
+        double tickRate = tickStats.ticks / timeDiff / service.engine().threadCount();
+        if (service.engine().isFreeRunning()) {
+            tickLabel->setText("Ticks: free-running");
+        } else {
+            tickLabel->setText(QString("Ticks: %1 Hz (target %2 Hz), lateness avg %3 us, max %4 us, missed %5")
+                                   .arg(tickRate, 0, 'f', 1)
+                                   .arg(service.engine().tickRate(), 0, 'f', 1)
+                                   .arg(tickStats.meanLatenessUs, 0, 'f', 1)
+                                   .arg(tickStats.maxLatenessUs, 0, 'f', 1)
+                                   .arg(tickStats.missed));
+        }
 
-        previousSum = currentSum;
+        previousShardIncrements = shardIncrements;
         elapsedTimer.restart();
 }
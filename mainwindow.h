@@ -2,66 +2,68 @@
 #define MAINWINDOW_H
 
 #include <QMainWindow>
-#include <QTableWidget>
+#include <QTableView>
 #include <QPushButton>
+#include <QCheckBox>
 #include <QLabel>
 #include <QTimer>
 #include <QElapsedTimer>
+#include <QProgressBar>
 
-#include <vector>
-#include <mutex>
-#include <thread>
-#include <atomic>
-
-class CounterManager {
-     Q_DISABLE_COPY(CounterManager)
-public:
-    CounterManager() = default;
-    ~CounterManager() {};
-    void addCounter(int value);
-    void deleteCounter(int index);
-    std::vector<int> getCounters() const;
-    void incrementAll();
-    void setCounters(const std::vector<int>& counters);
+#include "engineconfig.h"
+#include "counterservice.h"
+#include "countertablemodel.h"
 
-private:
-    mutable std::mutex mutex_;
-    std::vector<int> counters_;
-};
+#include <vector>
+#include <cstdint>
 
 class MainWindow : public QMainWindow {
     Q_OBJECT
 
 public:
-    explicit MainWindow(QWidget *parent = nullptr);
+    explicit MainWindow(const EngineConfig &config, QWidget *parent = nullptr);
     ~MainWindow();
 
 private slots:
     void onAddClicked();
     void onDeleteClicked();
     void onSaveClicked();
+    void onMaxThroughputToggled(bool enabled);
+    void onPauseToggled(bool paused);
     void updateTable();
     void updateFrequency();
-    void loadCountersFromDatabase();
+    void onCountersLoaded(bool ok, const QString &error);
+    void onSaveProgress(int done, int total);
+    void onCountersSaved(bool ok, const QString &error, int inserted, int updated, int deleted);
+    void onCheckpointed(bool ok, const QString &error, double durationMs, qint64 rows, bool complete);
 
 private:
     void setupUI();
     void adjustWindowSize();
 
-    QTableWidget *tableWidget;
+    QTableView *tableView;
+    CounterTableModel *tableModel;
     QPushButton *addButton;
     QPushButton *deleteButton;
     QPushButton *saveButton;
+    QCheckBox *maxThroughputBox;
+    QCheckBox *pauseBox;
     QLabel *freqLabel;
+    QLabel *shardLabel;
+    QLabel *tickLabel;
+    QProgressBar *saveProgressBar;
+    QLabel *checkpointLabel;
     QTimer *tableTimer;
     QTimer *freqTimer;
 
-    CounterManager counterManager;
-    std::thread workerThread;
-    std::atomic<bool> keepRunning{true};
+    // Counters, workers, rate sampler and persistence; the window only
+    // displays and drives it.
+    CounterService service;
+    int checkpointCount = 0;
+    qint64 checkpointRows = 0;
 
     QElapsedTimer elapsedTimer;
-    double previousSum = 0;
+    std::vector<uint64_t> previousShardIncrements;
 };
 
 #endif // MAINWINDOW_H
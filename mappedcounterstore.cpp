@@ -0,0 +1,322 @@
+#include "mappedcounterstore.h"
+
+#include <QtEndian>
+
+#include <algorithm>
+#include <limits>
+
+#ifdef Q_OS_UNIX
+#include <sys/mman.h>
+#include <unistd.h>
+#elif defined(Q_OS_WIN)
+#include <windows.h>
+#endif
+
+struct MappedCounterStore::Header {
+    quint32 magic;
+    quint32 version;
+    quint64 sequence;
+    quint64 offset;
+    quint64 capacity;
+    quint64 count;
+    quint64 checksum;
+    quint64 headerChecksum;
+    quint64 reserved;
+};
+
+struct MappedCounterStore::Record {
+    quint64 id;
+    qint64 value;
+};
+
+namespace {
+
+constexpr quint32 kMagic = 0x4d544e43; // "CNTM"
+constexpr quint32 kVersion = 2;
+constexpr std::size_t kSlotSize = 64;
+constexpr std::size_t kRecordSize = 16;
+constexpr std::size_t kInitialCapacity = 1024;
+
+bool fail(QString *error, const QString &message) {
+    if (error) *error = message;
+    return false;
+}
+
+quint64 mix(quint64 x) {
+    // splitmix64 finalizer.
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+// Per-record term of the records checksum. Includes the slot so that
+// moved records are detected too.
+quint64 recordHash(std::size_t slot, quint64 id, qint64 value) {
+    return mix(slot ^ mix(id ^ mix(static_cast<quint64>(value))));
+}
+
+// Catches a header slot torn by a crash while it was written.
+quint64 headerHash(quint64 sequence, quint64 offset, quint64 capacity, quint64 count, quint64 checksum) {
+    return mix(sequence ^ mix(offset ^ mix(capacity ^ mix(count ^ mix(checksum)))));
+}
+
+bool isZero(const uchar *data, std::size_t size) {
+    return std::all_of(data, data + size, [](uchar byte) { return byte == 0; });
+}
+
+} // namespace
+
+MappedCounterStore::MappedCounterStore(const QString &path)
+    : file_(path) {
+    static_assert(sizeof(Header) == kSlotSize, "header layout");
+    static_assert(2 * kSlotSize == kHeaderSize, "header slots");
+    static_assert(sizeof(Record) == kRecordSize, "record layout");
+}
+
+MappedCounterStore::~MappedCounterStore() {
+    unmap();
+}
+
+bool MappedCounterStore::load(CounterManager &manager, QString *error) {
+    std::vector<uint64_t> ids;
+    std::vector<CounterManager::Value> values;
+    if (!open(error, &ids, &values)) {
+        unmap();
+        failed_ = true;
+        return false;
+    }
+    failed_ = false;
+    manager.setCounters(values, ids);
+    return true;
+}
+
+bool MappedCounterStore::save(const CounterManager &manager, SaveStats *stats, QString *error,
+                              const Progress &progress) {
+    if (failed_) {
+        return fail(error, "Not saving over " + file_.fileName() + ": it failed to load");
+    }
+    if (!mapping_ && !open(error)) {
+        unmap();
+        failed_ = true;
+        return false;
+    }
+
+    std::vector<uint64_t> ids;
+    std::vector<CounterManager::Value> values;
+    manager.getCountersWithIds(ids, values);
+    const std::size_t count = ids.size();
+
+    // Write the region the current image is not in, placing it in new
+    // space at the end of the file when it is missing or too small.
+    const int target = current_ == 0 ? 1 : 0;
+    if (count > regions_[target].capacity || regions_[target].offset == 0) {
+        const std::size_t capacity = std::max({count, regions_[target].capacity * 2, kInitialCapacity});
+        const std::size_t offset = size_;
+        if (!map(offset + capacity * kRecordSize, error)) return false;
+        regions_[target].offset = offset;
+        regions_[target].capacity = capacity;
+    }
+    const Region &region = regions_[target];
+    const Record *old = current_ >= 0 ? records(regions_[current_]) : nullptr;
+    Record *r = records(region);
+
+    // Stats compare against the current image, per record slot: a delete
+    // in the middle shows up as updates of the slots after it. Stores only
+    // happen where the target region differs.
+    SaveStats result;
+    quint64 checksum = 0;
+    std::size_t dirtyBegin = std::numeric_limits<std::size_t>::max();
+    std::size_t dirtyEnd = 0;
+    for (std::size_t i = 0; i < count; ++i) {
+        if (progress && ((i + 1) & 4095) == 0) {
+            progress(static_cast<int>(i + 1), static_cast<int>(count));
+        }
+
+        const quint64 id = ids[i];
+        const qint64 value = values[i];
+        checksum += recordHash(i, id, value);
+        if (i >= count_) {
+            ++result.inserted;
+        } else if (qFromLittleEndian(old[i].id) != id || qFromLittleEndian(old[i].value) != value) {
+            ++result.updated;
+        }
+        if (qFromLittleEndian(r[i].id) == id && qFromLittleEndian(r[i].value) == value) continue;
+        r[i].id = qToLittleEndian(id);
+        r[i].value = qToLittleEndian(value);
+        dirtyBegin = std::min(dirtyBegin, i);
+        dirtyEnd = i + 1;
+    }
+    if (count_ > count) {
+        result.deleted = static_cast<int>(count_ - count);
+    }
+
+    // Records first, then the slot that flips to them, so the newest valid
+    // slot never describes records that are not on disk yet.
+    if (dirtyBegin < dirtyEnd
+        && !sync(region.offset + dirtyBegin * kRecordSize, (dirtyEnd - dirtyBegin) * kRecordSize, error)) {
+        return false;
+    }
+    const quint64 sequence = sequence_ + 1;
+    Header *h = header(target);
+    h->magic = qToLittleEndian(kMagic);
+    h->version = qToLittleEndian(kVersion);
+    h->sequence = qToLittleEndian(sequence);
+    h->offset = qToLittleEndian(static_cast<quint64>(region.offset));
+    h->capacity = qToLittleEndian(static_cast<quint64>(region.capacity));
+    h->count = qToLittleEndian(static_cast<quint64>(count));
+    h->checksum = qToLittleEndian(checksum);
+    h->headerChecksum = qToLittleEndian(headerHash(sequence, region.offset, region.capacity, count, checksum));
+    h->reserved = 0;
+    if (!sync(target * kSlotSize, kSlotSize, error)) return false;
+    current_ = target;
+    sequence_ = sequence;
+    count_ = count;
+
+    result.rows = result.inserted + result.updated;
+    if (progress) progress(static_cast<int>(count), static_cast<int>(count));
+    if (stats) *stats = result;
+    return true;
+}
+
+bool MappedCounterStore::checkpoint(const CounterManager &manager, int maxWrites,
+                                    SaveStats *stats, QString *error) {
+    Q_UNUSED(maxWrites);
+    return save(manager, stats, error);
+}
+
+void MappedCounterStore::invalidate() {
+    // Saves diff against the file itself, which is always the saved image.
+}
+
+// Maps the file and finds the newest slot whose header and records check
+// out, decoding its records into ids and values when given.
+bool MappedCounterStore::open(QString *error, std::vector<uint64_t> *ids, std::vector<CounterManager::Value> *values) {
+    unmap();
+    regions_[0] = regions_[1] = Region();
+    current_ = -1;
+    sequence_ = 0;
+    count_ = 0;
+
+    if (!file_.isOpen() && !file_.open(QIODevice::ReadWrite)) {
+        return fail(error, "Cannot open " + file_.fileName() + ": " + file_.errorString());
+    }
+    const qint64 fileSize = file_.size();
+    if (fileSize != 0 && static_cast<std::size_t>(fileSize) < kHeaderSize) {
+        return fail(error, file_.fileName() + " is not a counter file");
+    }
+    if (!map(std::max<std::size_t>(fileSize, kHeaderSize), error)) return false;
+    // A new file, or one that crashed before its first save finished.
+    if (isZero(mapping_, kHeaderSize)) {
+        if (ids) ids->clear();
+        if (values) values->clear();
+        return true;
+    }
+
+    int slots[2];
+    int valid = 0;
+    for (int slot = 0; slot < 2; ++slot) {
+        const Header *h = header(slot);
+        const quint64 sequence = qFromLittleEndian(h->sequence);
+        const quint64 offset = qFromLittleEndian(h->offset);
+        const quint64 capacity = qFromLittleEndian(h->capacity);
+        const quint64 count = qFromLittleEndian(h->count);
+        const quint64 checksum = qFromLittleEndian(h->checksum);
+        if (qFromLittleEndian(h->magic) != kMagic || qFromLittleEndian(h->version) != kVersion || sequence == 0
+            || headerHash(sequence, offset, capacity, count, checksum) != qFromLittleEndian(h->headerChecksum)
+            || offset < kHeaderSize || offset % kRecordSize != 0 || offset > size_
+            || capacity > (size_ - offset) / kRecordSize || count > capacity) {
+            continue;
+        }
+        regions_[slot].offset = offset;
+        regions_[slot].capacity = capacity;
+        slots[valid++] = slot;
+    }
+    if (valid == 2) {
+        if (qFromLittleEndian(header(slots[1])->sequence) > qFromLittleEndian(header(slots[0])->sequence)) {
+            std::swap(slots[0], slots[1]);
+        }
+        // Saves never write overlapping regions; if these do, the older
+        // one is not an image.
+        const Region &a = regions_[slots[0]];
+        Region &b = regions_[slots[1]];
+        if (a.offset < b.offset + b.capacity * kRecordSize && b.offset < a.offset + a.capacity * kRecordSize) {
+            b = Region();
+            valid = 1;
+        }
+    }
+
+    for (int i = 0; i < valid; ++i) {
+        const int slot = slots[i];
+        const Header *h = header(slot);
+        const std::size_t count = qFromLittleEndian(h->count);
+        const Record *r = records(regions_[slot]);
+        if (ids) ids->resize(count);
+        if (values) values->resize(count);
+        quint64 checksum = 0;
+        for (std::size_t j = 0; j < count; ++j) {
+            const quint64 id = qFromLittleEndian(r[j].id);
+            const qint64 value = qFromLittleEndian(r[j].value);
+            if (ids) (*ids)[j] = id;
+            if (values) (*values)[j] = value;
+            checksum += recordHash(j, id, value);
+        }
+        if (checksum == qFromLittleEndian(h->checksum)) {
+            current_ = slot;
+            sequence_ = qFromLittleEndian(h->sequence);
+            count_ = count;
+            return true;
+        }
+    }
+    return fail(error, file_.fileName() + (valid ? " is corrupt (checksum mismatch)" : " has an unknown format"));
+}
+
+bool MappedCounterStore::map(std::size_t size, QString *error) {
+    unmap();
+    if (file_.size() < static_cast<qint64>(size) && !file_.resize(static_cast<qint64>(size))) {
+        return fail(error, "Cannot grow " + file_.fileName() + ": " + file_.errorString());
+    }
+    mapping_ = file_.map(0, static_cast<qint64>(size));
+    if (!mapping_) {
+        return fail(error, "Cannot map " + file_.fileName() + ": " + file_.errorString());
+    }
+    size_ = size;
+    return true;
+}
+
+void MappedCounterStore::unmap() {
+    if (mapping_) {
+        file_.unmap(mapping_);
+        mapping_ = nullptr;
+        size_ = 0;
+    }
+}
+
+// Flushes the pages covering [offset, offset + length) to disk.
+bool MappedCounterStore::sync(std::size_t offset, std::size_t length, QString *error) {
+#ifdef Q_OS_UNIX
+    static const std::size_t pageSize = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+    const std::size_t begin = offset / pageSize * pageSize;
+    if (::msync(mapping_ + begin, offset + length - begin, MS_SYNC) != 0) {
+        return fail(error, "msync failed on " + file_.fileName());
+    }
+#elif defined(Q_OS_WIN)
+    if (!::FlushViewOfFile(mapping_ + offset, length)) {
+        return fail(error, "Cannot flush " + file_.fileName());
+    }
+#else
+    Q_UNUSED(offset);
+    Q_UNUSED(length);
+    Q_UNUSED(error);
+#endif
+    return true;
+}
+
+MappedCounterStore::Header *MappedCounterStore::header(int slot) const {
+    return reinterpret_cast<Header *>(mapping_ + slot * kSlotSize);
+}
+
+MappedCounterStore::Record *MappedCounterStore::records(const Region &region) const {
+    return reinterpret_cast<Record *>(mapping_ + region.offset);
+}
@@ -0,0 +1,78 @@
+#ifndef MAPPEDCOUNTERSTORE_H
+#define MAPPEDCOUNTERSTORE_H
+
+#include "counterbackend.h"
+
+#include <QFile>
+#include <QString>
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Persists a CounterManager as one binary file mapped into memory:
+//
+//   header   two 64-byte slots: magic, version, sequence, region offset,
+//            region capacity, count, records checksum, header checksum
+//   regions  one per slot, count x {uint64 id, int64 value}, packed,
+//            little endian
+//
+// Load is a single pass over the region of the newest slot that checks
+// out. A save never touches that image: it diffs the manager against the
+// other region, stores only the records that differ there, msyncs them
+// and then flips to it by writing that region's slot with the next
+// sequence number. A crash at any point leaves the previous image
+// loadable.
+//
+// After a failed load the store refuses to save, so it never overwrites a
+// file it could not read.
+class MappedCounterStore : public CounterBackend {
+     Q_DISABLE_COPY(MappedCounterStore)
+public:
+    // Both header slots; the regions follow.
+    static constexpr std::size_t kHeaderSize = 128;
+
+    explicit MappedCounterStore(const QString &path);
+    ~MappedCounterStore() override;
+
+    bool load(CounterManager &manager, QString *error = nullptr) override;
+    bool save(const CounterManager &manager, SaveStats *stats = nullptr, QString *error = nullptr,
+              const Progress &progress = Progress()) override;
+    // Writes are memory stores, so the limit is ignored and every
+    // checkpoint is complete.
+    bool checkpoint(const CounterManager &manager, int maxWrites,
+                    SaveStats *stats = nullptr, QString *error = nullptr) override;
+    void invalidate() override;
+
+private:
+    struct Header;
+    struct Record;
+
+    // Where one slot's records live in the file.
+    struct Region {
+        std::size_t offset = 0;
+        std::size_t capacity = 0;
+    };
+
+    bool open(QString *error, std::vector<uint64_t> *ids = nullptr,
+              std::vector<CounterManager::Value> *values = nullptr);
+    bool map(std::size_t size, QString *error);
+    void unmap();
+    bool sync(std::size_t offset, std::size_t length, QString *error);
+    Header *header(int slot) const;
+    Record *records(const Region &region) const;
+
+    QFile file_;
+    uchar *mapping_ = nullptr;
+    std::size_t size_ = 0;
+
+    Region regions_[2];
+    // Slot of the image on disk, -1 while the file holds none.
+    int current_ = -1;
+    quint64 sequence_ = 0;
+    std::size_t count_ = 0;
+    // Set by a failed load; saves are refused until a load succeeds.
+    bool failed_ = false;
+};
+
+#endif // MAPPEDCOUNTERSTORE_H
@@ -0,0 +1,197 @@
+#include "rateestimator.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Differences are taken modulo 2^64 like the running total itself.
+double perSecond(uint64_t from, uint64_t to, RateEstimator::Clock::duration elapsed) {
+    const double seconds = std::chrono::duration<double>(elapsed).count();
+    return seconds > 0 ? static_cast<int64_t>(to - from) / seconds : 0.0;
+}
+
+} // namespace
+
+RateEstimator::RateEstimator(CounterManager &manager, int sampleIntervalMs, double ewmaTimeConstantSec)
+    : manager_(manager),
+      interval_(std::chrono::milliseconds(std::max(1, sampleIntervalMs))),
+      ewmaTimeConstantSec_(ewmaTimeConstantSec) {
+    // Enough samples to span the 60 s window plus its older end.
+    ring_.resize(std::chrono::seconds(60) / interval_ + 2);
+}
+
+RateEstimator::~RateEstimator() {
+    stop();
+}
+
+void RateEstimator::start() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (running_) return;
+    running_ = true;
+    thread_ = std::thread(&RateEstimator::run, this);
+}
+
+void RateEstimator::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+    }
+    wake_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void RateEstimator::watchRows(int first, int count) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (first == watchFirst_ && count == watchCount_) return;
+    watchFirst_ = first;
+    watchCount_ = count;
+    ++watchEpoch_;
+}
+
+RateEstimator::Rates RateEstimator::totalRates() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return rates([](const Sample &sample) { return sample.total; }, totalEwma_);
+}
+
+RateEstimator::Rates RateEstimator::tickRates() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return rates([](const Sample &sample) { return sample.ticks; }, tickEwma_);
+}
+
+bool RateEstimator::rowRate(int row, double *rate) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (size_ < 2) return false;
+
+    const Sample &newer = at(0);
+    const int offset = row - newer.rowsFirst;
+    if (offset < 0 || offset >= static_cast<int>(newer.rows.size())) return false;
+
+    // Same walk as windowEnds(), but history ends where the epoch changed.
+    const Sample *older = nullptr;
+    for (std::size_t age = 1; age < size_; ++age) {
+        const Sample &sample = at(age);
+        if (sample.watchEpoch != newer.watchEpoch || sample.rowsFirst != newer.rowsFirst
+            || sample.rows.size() != newer.rows.size()
+            || newer.time - sample.time > std::chrono::seconds(1) + interval_ / 2) {
+            break;
+        }
+        older = &sample;
+    }
+    if (!older) return false;
+
+    *rate = perSecond(static_cast<uint64_t>(older->rows[offset]),
+                      static_cast<uint64_t>(newer.rows[offset]), newer.time - older->time);
+    return true;
+}
+
+void RateEstimator::run() {
+    Clock::time_point next = Clock::now();
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (running_) {
+        lock.unlock();
+        takeSample();
+        lock.lock();
+
+        next += interval_;
+        const Clock::time_point now = Clock::now();
+        if (next < now) {
+            // Fell behind (suspended, overloaded); realign instead of
+            // sampling back to back.
+            next = now + interval_;
+        }
+        wake_.wait_until(lock, next, [this]() { return !running_; });
+    }
+}
+
+void RateEstimator::takeSample() {
+    int first = 0;
+    int count = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        first = watchFirst_;
+        count = watchCount_;
+    }
+
+    // Only the watched rows are copied, never the whole array. Their
+    // handles come from the same read, so they name exactly these values.
+    std::vector<CounterManager::Handle> handles;
+    std::vector<CounterManager::Value> rows = manager_.getRange(first, count, &handles);
+    const uint64_t total = static_cast<uint64_t>(manager_.total());
+    const uint64_t ticks = manager_.ticks();
+    const Clock::time_point time = Clock::now();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (handles != lastHandles_) {
+        // Other counters moved under the watched range.
+        lastHandles_.swap(handles);
+        ++watchEpoch_;
+    }
+
+    Sample &sample = ring_[head_];
+    sample.time = time;
+    sample.total = total;
+    sample.ticks = ticks;
+    sample.watchEpoch = watchEpoch_;
+    sample.rowsFirst = first;
+    // Swap so the slot's old buffer is released on this thread.
+    sample.rows.swap(rows);
+
+    head_ = (head_ + 1) % ring_.size();
+    size_ = std::min(size_ + 1, ring_.size());
+    if (size_ < 2) return;
+
+    const Sample &previous = at(1);
+    const Clock::duration elapsed = time - previous.time;
+    const double alpha = 1.0 - std::exp(-std::chrono::duration<double>(elapsed).count() / ewmaTimeConstantSec_);
+    const double totalRate = perSecond(previous.total, total, elapsed);
+    const double tickRate = perSecond(previous.ticks, ticks, elapsed);
+    if (size_ == 2) {
+        totalEwma_ = totalRate;
+        tickEwma_ = tickRate;
+    } else {
+        totalEwma_ += alpha * (totalRate - totalEwma_);
+        tickEwma_ += alpha * (tickRate - tickEwma_);
+    }
+}
+
+// Caller holds mutex_.
+bool RateEstimator::windowEnds(Clock::duration window, const Sample **older, const Sample **newer) const {
+    if (size_ < 2) return false;
+
+    *newer = &at(0);
+    *older = &at(1);
+    // Half an interval of slack so sampling jitter does not drop the
+    // sample that is just over the window.
+    for (std::size_t age = 2; age < size_; ++age) {
+        const Sample &sample = at(age);
+        if ((*newer)->time - sample.time > window + interval_ / 2) break;
+        *older = &sample;
+    }
+    return true;
+}
+
+template <typename Field>
+RateEstimator::Rates RateEstimator::rates(Field field, double ewma) const {
+    Rates result;
+    const Sample *older = nullptr;
+    const Sample *newer = nullptr;
+    auto rateOver = [&](Clock::duration window) {
+        if (!windowEnds(window, &older, &newer)) return 0.0;
+        return perSecond(field(*older), field(*newer), newer->time - older->time);
+    };
+
+    result.instant = rateOver(Clock::duration::zero());
+    result.window1s = rateOver(std::chrono::seconds(1));
+    result.window10s = rateOver(std::chrono::seconds(10));
+    result.window60s = rateOver(std::chrono::seconds(60));
+    result.ewma = ewma;
+    return result;
+}
+
+// Sample taken `age` samples before the newest one.
+const RateEstimator::Sample &RateEstimator::at(std::size_t age) const {
+    return ring_[(head_ + ring_.size() - 1 - age) % ring_.size()];
+}
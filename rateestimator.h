@@ -0,0 +1,103 @@
+#ifndef RATEESTIMATOR_H
+#define RATEESTIMATOR_H
+
+#include "countermanager.h"
+
+#include <QtGlobal>
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+// Samples a CounterManager on its own thread and turns the samples into
+// rates. Each sample records the running total, the tick count and the
+// values of a small watched range of rows (the visible ones), so neither
+// the sampling nor the queries ever walk the whole counter array. Samples
+// live in a ring buffer long enough for the widest window.
+class RateEstimator {
+     Q_DISABLE_COPY(RateEstimator)
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Rates in Hz. The windowed rates fall back to the available history
+    // while the estimator has run for less than the window.
+    struct Rates {
+        // Between the two newest samples.
+        double instant = 0;
+        double window1s = 0;
+        double window10s = 0;
+        double window60s = 0;
+        // Exponentially weighted average of the instant rate.
+        double ewma = 0;
+    };
+
+    explicit RateEstimator(CounterManager &manager, int sampleIntervalMs = 100,
+                           double ewmaTimeConstantSec = 5.0);
+    ~RateEstimator();
+
+    void start();
+    void stop();
+
+    // Rows whose per-counter rates are tracked from the next sample on.
+    // Moving the range restarts their history.
+    void watchRows(int first, int count);
+
+    // Increments per second summed over all counters.
+    Rates totalRates() const;
+    // Increment passes per second, i.e. the rate of a counter that is only
+    // changed by increments.
+    Rates tickRates() const;
+    // 1 s rate of a watched row, or false if the row is not watched or has
+    // fewer than two samples yet.
+    bool rowRate(int row, double *rate) const;
+
+private:
+    struct Sample {
+        Clock::time_point time;
+        uint64_t total = 0;
+        uint64_t ticks = 0;
+        // Values of the watched rows starting at rowsFirst; only comparable
+        // between samples of the same watch epoch and range.
+        uint64_t watchEpoch = 0;
+        int rowsFirst = 0;
+        std::vector<CounterManager::Value> rows;
+    };
+
+    void run();
+    void takeSample();
+    // Newest sample and the oldest one no more than `window` before it.
+    bool windowEnds(Clock::duration window, const Sample **older, const Sample **newer) const;
+    template <typename Field>
+    Rates rates(Field field, double ewma) const;
+    const Sample &at(std::size_t age) const;
+
+    CounterManager &manager_;
+    const Clock::duration interval_;
+    const double ewmaTimeConstantSec_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;
+    bool running_ = false;
+    std::thread thread_;
+
+    // Ring of the last ring_.size() samples; head_ is the next slot.
+    std::vector<Sample> ring_;
+    std::size_t head_ = 0;
+    std::size_t size_ = 0;
+    double totalEwma_ = 0;
+    double tickEwma_ = 0;
+
+    int watchFirst_ = 0;
+    int watchCount_ = 0;
+    uint64_t watchEpoch_ = 0;
+    // Handles of the watched rows at the previous sample. A structural
+    // change that moves other counters under the range changes them, even
+    // when the count stays the same, so it starts a new epoch too.
+    std::vector<CounterManager::Handle> lastHandles_;
+};
+
+#endif // RATEESTIMATOR_H
@@ -0,0 +1,209 @@
+#include "slotindex.h"
+
+#include <algorithm>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace {
+
+int popcount(uint64_t word) {
+#ifdef _MSC_VER
+    return static_cast<int>(__popcnt64(word));
+#else
+    return __builtin_popcountll(word);
+#endif
+}
+
+// word must not be zero.
+int lowestBit(uint64_t word) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, word);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctzll(word);
+#endif
+}
+
+// Bits [from, 64) of a word.
+uint64_t maskFrom(std::size_t from) {
+    return from >= 64 ? 0 : ~uint64_t(0) << from;
+}
+
+} // namespace
+
+void SlotIndex::reset(std::size_t slots) {
+    const std::size_t blocks = (slots + kBlockSlots - 1) / kBlockSlots;
+    size_ = slots;
+    live_ = slots;
+    bits_.assign(blocks * kWordsPerBlock, ~uint64_t(0));
+    if (slots % 64 != 0) {
+        bits_[slots / 64] = ~maskFrom(slots % 64);
+    }
+    std::fill(bits_.begin() + (slots + 63) / 64, bits_.end(), 0);
+
+    blockLive_.assign(blocks, kBlockSlots);
+    if (slots % kBlockSlots != 0) {
+        blockLive_.back() = slots % kBlockSlots;
+    }
+    rebuildTree();
+}
+
+void SlotIndex::append() {
+    const std::size_t slot = size_;
+    const std::size_t block = slot / kBlockSlots;
+    if (block == blockCount()) {
+        bits_.resize(bits_.size() + kWordsPerBlock, 0);
+        blockLive_.push_back(0);
+        // Once per kBlockSlots appends, so the O(blocks) rebuild amortizes.
+        rebuildTree();
+    }
+    bits_[slot / 64] |= uint64_t(1) << (slot % 64);
+    ++blockLive_[block];
+    treeAdd(block, 1);
+    ++size_;
+    ++live_;
+}
+
+void SlotIndex::kill(std::size_t slot) {
+    const std::size_t block = slot / kBlockSlots;
+    bits_[slot / 64] &= ~(uint64_t(1) << (slot % 64));
+    --blockLive_[block];
+    treeAdd(block, -1);
+    --live_;
+}
+
+void SlotIndex::truncate(std::size_t slots) {
+    const std::size_t blocks = (slots + kBlockSlots - 1) / kBlockSlots;
+    size_ = slots;
+    bits_.resize(blocks * kWordsPerBlock);
+    blockLive_.resize(blocks);
+    rebuildTree();
+}
+
+void SlotIndex::setLive(std::size_t slot, bool live) {
+    const uint64_t bit = uint64_t(1) << (slot % 64);
+    if (live) {
+        bits_[slot / 64] |= bit;
+    } else {
+        bits_[slot / 64] &= ~bit;
+    }
+}
+
+void SlotIndex::reindex(std::size_t begin, std::size_t end) {
+    if (begin >= end) return;
+    for (std::size_t block = begin / kBlockSlots; block <= (end - 1) / kBlockSlots; ++block) {
+        const std::size_t count = liveInBlock(block);
+        const int64_t delta = static_cast<int64_t>(count) - blockLive_[block];
+        if (delta == 0) continue;
+        blockLive_[block] = static_cast<uint32_t>(count);
+        treeAdd(block, delta);
+        live_ += delta;
+    }
+}
+
+std::size_t SlotIndex::select(std::size_t row) const {
+    // Descend the Fenwick tree to the block holding the row.
+    std::size_t block = 0;
+    uint64_t remaining = row;
+    std::size_t step = 1;
+    while (step * 2 <= blockCount()) step *= 2;
+    for (; step > 0; step /= 2) {
+        if (block + step <= blockCount() && tree_[block + step] <= remaining) {
+            block += step;
+            remaining -= tree_[block];
+        }
+    }
+
+    // Then scan the block's words.
+    std::size_t word = block * kWordsPerBlock;
+    for (;; ++word) {
+        const uint64_t count = popcount(bits_[word]);
+        if (remaining < count) break;
+        remaining -= count;
+    }
+    uint64_t bits = bits_[word];
+    for (; remaining > 0; --remaining) {
+        bits &= bits - 1;
+    }
+    return word * 64 + lowestBit(bits);
+}
+
+std::size_t SlotIndex::rank(std::size_t slot) const {
+    const std::size_t block = slot / kBlockSlots;
+    return treePrefix(block) + countLive(block * kBlockSlots, slot);
+}
+
+std::size_t SlotIndex::countLive(std::size_t begin, std::size_t end) const {
+    end = std::min(end, size_);
+    if (begin >= end) return 0;
+
+    const std::size_t first = begin / 64;
+    const std::size_t last = (end - 1) / 64;
+    if (first == last) {
+        return popcount(bits_[first] & maskFrom(begin % 64) & ~maskFrom(end - first * 64));
+    }
+    std::size_t count = popcount(bits_[first] & maskFrom(begin % 64));
+    for (std::size_t word = first + 1; word < last; ++word) {
+        count += popcount(bits_[word]);
+    }
+    return count + popcount(bits_[last] & ~maskFrom(end - last * 64));
+}
+
+std::size_t SlotIndex::nextLive(std::size_t slot) const {
+    if (slot >= size_) return size_;
+    std::size_t word = slot / 64;
+    uint64_t bits = bits_[word] & maskFrom(slot % 64);
+    while (bits == 0) {
+        if (++word * 64 >= size_) return size_;
+        bits = bits_[word];
+    }
+    return std::min(size_, word * 64 + lowestBit(bits));
+}
+
+std::size_t SlotIndex::nextDead(std::size_t slot) const {
+    if (slot >= size_) return size_;
+    std::size_t word = slot / 64;
+    uint64_t bits = ~bits_[word] & maskFrom(slot % 64);
+    while (bits == 0) {
+        if (++word * 64 >= size_) return size_;
+        bits = ~bits_[word];
+    }
+    // Bits past size_ are clear, so they read as dead; clamp them.
+    return std::min(size_, word * 64 + lowestBit(bits));
+}
+
+std::size_t SlotIndex::liveInBlock(std::size_t block) const {
+    std::size_t count = 0;
+    for (std::size_t word = 0; word < kWordsPerBlock; ++word) {
+        count += popcount(bits_[block * kWordsPerBlock + word]);
+    }
+    return count;
+}
+
+void SlotIndex::treeAdd(std::size_t block, int64_t delta) {
+    for (std::size_t i = block + 1; i <= blockCount(); i += i & (~i + 1)) {
+        tree_[i] += delta;
+    }
+}
+
+std::size_t SlotIndex::treePrefix(std::size_t blocks) const {
+    uint64_t sum = 0;
+    for (std::size_t i = blocks; i > 0; i -= i & (~i + 1)) {
+        sum += tree_[i];
+    }
+    return sum;
+}
+
+void SlotIndex::rebuildTree() {
+    tree_.assign(blockCount() + 1, 0);
+    for (std::size_t i = 1; i <= blockCount(); ++i) {
+        tree_[i] += blockLive_[i - 1];
+        const std::size_t parent = i + (i & (~i + 1));
+        if (parent <= blockCount()) {
+            tree_[parent] += tree_[i];
+        }
+    }
+}
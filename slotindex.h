@@ -0,0 +1,65 @@
+#ifndef SLOTINDEX_H
+#define SLOTINDEX_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Tracks which physical slots of a tombstoned array are live and maps
+// logical rows (the n-th live slot) to slots. Liveness is a bitmap; live
+// counts per block of kBlockSlots slots sit in a Fenwick tree, so killing
+// a slot and looking up a row are O(log blocks) instead of an O(n) shift.
+// Not thread safe; the owner guards it.
+class SlotIndex {
+public:
+    static constexpr std::size_t kBlockSlots = 512;
+
+    // Makes `slots` slots, all live.
+    void reset(std::size_t slots);
+    // Adds a live slot at the end.
+    void append();
+    // Marks a live slot dead.
+    void kill(std::size_t slot);
+    // Drops the slots from `slots` on; they must all be dead.
+    void truncate(std::size_t slots);
+
+    // Bulk edits for compaction: flip bits with setLive(), then reindex()
+    // the touched range once.
+    void setLive(std::size_t slot, bool live);
+    void reindex(std::size_t begin, std::size_t end);
+
+    bool isLive(std::size_t slot) const {
+        return (bits_[slot / 64] >> (slot % 64)) & 1;
+    }
+    std::size_t size() const { return size_; }
+    std::size_t live() const { return live_; }
+    std::size_t dead() const { return size_ - live_; }
+
+    // Slot of row `row`; row must be < live().
+    std::size_t select(std::size_t row) const;
+    // Row of slot `slot`, i.e. the live slots before it.
+    std::size_t rank(std::size_t slot) const;
+    // Live slots in [begin, end).
+    std::size_t countLive(std::size_t begin, std::size_t end) const;
+    // First live (dead) slot at or after `slot`, or size() if none.
+    std::size_t nextLive(std::size_t slot) const;
+    std::size_t nextDead(std::size_t slot) const;
+
+private:
+    static constexpr std::size_t kWordsPerBlock = kBlockSlots / 64;
+
+    std::size_t blockCount() const { return blockLive_.size(); }
+    std::size_t liveInBlock(std::size_t block) const;
+    void treeAdd(std::size_t block, int64_t delta);
+    std::size_t treePrefix(std::size_t blocks) const;
+    void rebuildTree();
+
+    std::size_t size_ = 0;
+    std::size_t live_ = 0;
+    std::vector<uint64_t> bits_;
+    // Live slots per block, plain and as a 1-based Fenwick tree.
+    std::vector<uint32_t> blockLive_;
+    std::vector<uint64_t> tree_;
+};
+
+#endif // SLOTINDEX_H
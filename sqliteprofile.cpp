@@ -0,0 +1,66 @@
+#include "sqliteprofile.h"
+
+#include <QSqlError>
+#include <QSqlQuery>
+
+SqliteProfile SqliteProfile::defaults() {
+    SqliteProfile profile;
+    profile.name = "default";
+    return profile;
+}
+
+SqliteProfile SqliteProfile::balanced() {
+    SqliteProfile profile;
+    profile.name = "balanced";
+    profile.journalMode = "WAL";
+    profile.synchronous = "NORMAL";
+    profile.cacheSizeKiB = 64 * 1024;
+    profile.mmapSize = qint64(256) * 1024 * 1024;
+    profile.tempStoreMemory = true;
+    return profile;
+}
+
+SqliteProfile SqliteProfile::fast() {
+    SqliteProfile profile;
+    profile.name = "fast";
+    profile.journalMode = "WAL";
+    profile.synchronous = "OFF";
+    profile.cacheSizeKiB = 256 * 1024;
+    profile.mmapSize = qint64(1024) * 1024 * 1024;
+    profile.tempStoreMemory = true;
+    return profile;
+}
+
+QStringList SqliteProfile::names() {
+    return {"default", "balanced", "fast"};
+}
+
+bool SqliteProfile::fromName(const QString &name, SqliteProfile *profile) {
+    for (const SqliteProfile &preset : {defaults(), balanced(), fast()}) {
+        if (preset.name == name) {
+            *profile = preset;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool SqliteProfile::apply(QSqlDatabase &db, QString *error) const {
+    QStringList pragmas;
+    if (!journalMode.isEmpty()) pragmas << "PRAGMA journal_mode = " + journalMode;
+    if (!synchronous.isEmpty()) pragmas << "PRAGMA synchronous = " + synchronous;
+    // A negative cache_size is in KiB rather than pages.
+    if (cacheSizeKiB > 0) pragmas << QString("PRAGMA cache_size = -%1").arg(cacheSizeKiB);
+    if (mmapSize >= 0) pragmas << QString("PRAGMA mmap_size = %1").arg(mmapSize);
+    if (tempStoreMemory) pragmas << "PRAGMA temp_store = MEMORY";
+
+    QSqlQuery query(db);
+    for (const QString &pragma : pragmas) {
+        if (!query.exec(pragma)) {
+            if (error) *error = query.lastError().text();
+            return false;
+        }
+        query.finish();
+    }
+    return true;
+}
@@ -0,0 +1,39 @@
+#ifndef SQLITEPROFILE_H
+#define SQLITEPROFILE_H
+
+#include <QString>
+#include <QStringList>
+#include <QSqlDatabase>
+
+// Connection-level SQLite tuning, applied with PRAGMAs right after a
+// connection is opened. Empty or negative fields keep SQLite's default.
+struct SqliteProfile {
+    QString name;
+    // journal_mode: DELETE (default), WAL, ...
+    QString journalMode;
+    // synchronous: FULL (default), NORMAL, OFF.
+    QString synchronous;
+    // cache_size in KiB; 0 keeps the default (about 2 MiB).
+    int cacheSizeKiB = 0;
+    // mmap_size in bytes; -1 keeps the default (off).
+    qint64 mmapSize = -1;
+    // temp_store = MEMORY instead of files.
+    bool tempStoreMemory = false;
+
+    // SQLite defaults: rollback journal, fsync on every commit.
+    static SqliteProfile defaults();
+    // WAL with synchronous=NORMAL: commits no longer fsync, a power loss
+    // can drop the last transactions but never corrupts the database.
+    static SqliteProfile balanced();
+    // WAL with synchronous=OFF and large caches; an OS crash can corrupt
+    // the database. For benchmarks and throwaway data.
+    static SqliteProfile fast();
+
+    static QStringList names();
+    // Looks a preset up by name; returns false if there is none.
+    static bool fromName(const QString &name, SqliteProfile *profile);
+
+    bool apply(QSqlDatabase &db, QString *error = nullptr) const;
+};
+
+#endif // SQLITEPROFILE_H
@@ -0,0 +1,12 @@
+# CounterManager and SlotIndex tests; `make check` runs them.
+QT = core testlib
+
+CONFIG += console testcase
+CONFIG -= app_bundle
+
+TARGET = tst_countermanager
+
+include(../engine/engine.pri)
+
+SOURCES += \
+    tst_countermanager.cpp
@@ -0,0 +1,12 @@
+# Persistence tests; `make check` runs them.
+QT = core sql testlib
+
+CONFIG += console testcase
+CONFIG -= app_bundle
+
+TARGET = tst_persistence
+
+include(../engine/engine.pri)
+
+SOURCES += \
+    tst_persistence.cpp
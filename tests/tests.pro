@@ -0,0 +1,7 @@
+# Engine tests; `make check` runs them all. Both projects build in this
+# directory so engine.pri finds the library one level up.
+TEMPLATE = subdirs
+
+SUBDIRS = \
+    persistence.pro \
+    countermanager.pro
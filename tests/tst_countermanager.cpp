@@ -0,0 +1,446 @@
+#include "countermanager.h"
+#include "slotindex.h"
+
+#include <QtTest>
+
+#include <limits>
+#include <random>
+#include <vector>
+
+// SlotIndex and tombstone compaction checked against plain vectors: a
+// vector<bool> of live slots, and the (id, value) rows a manager without
+// tombstones would hold.
+class CounterManagerTest : public QObject {
+    Q_OBJECT
+
+private slots:
+    void slotIndexBoundaries();
+    void slotIndexRandom();
+    void compactStepRandom();
+
+    void handleStaleAfterDelete();
+    void handleStaleAfterSetCounters();
+    void handleStaleAfterCompaction();
+    void handleRetiredGeneration();
+    void handleRowRoundTrip();
+};
+
+namespace {
+
+using LiveModel = std::vector<bool>;
+
+struct RowModel {
+    std::vector<uint64_t> ids;
+    std::vector<CounterManager::Value> values;
+};
+
+// Checks every query of `index` against `model`, from every slot, so all
+// word and block boundaries in range are covered.
+void verify(const SlotIndex &index, const LiveModel &model) {
+    const std::size_t size = model.size();
+    std::vector<std::size_t> before(size + 1, 0);
+    for (std::size_t slot = 0; slot < size; ++slot) {
+        before[slot + 1] = before[slot] + (model[slot] ? 1 : 0);
+    }
+    QCOMPARE(index.size(), size);
+    QCOMPARE(index.live(), before[size]);
+    QCOMPARE(index.dead(), size - before[size]);
+
+    for (std::size_t slot = 0; slot < size; ++slot) {
+        QCOMPARE(index.isLive(slot), bool(model[slot]));
+        QCOMPARE(index.rank(slot), before[slot]);
+        if (model[slot]) {
+            QCOMPARE(index.select(before[slot]), slot);
+        }
+    }
+
+    std::size_t nextLive = size;
+    std::size_t nextDead = size;
+    QCOMPARE(index.nextLive(size), size);
+    QCOMPARE(index.nextDead(size), size);
+    for (std::size_t slot = size; slot-- > 0;) {
+        (model[slot] ? nextLive : nextDead) = slot;
+        QCOMPARE(index.nextLive(slot), nextLive);
+        QCOMPARE(index.nextDead(slot), nextDead);
+    }
+
+    // Range ends on both sides of block (512) edges, and of word (64)
+    // edges within the first two blocks.
+    std::vector<std::size_t> edges = {size, size + 1};
+    for (std::size_t edge = 0; edge <= size + SlotIndex::kBlockSlots; edge += 64) {
+        if (edge % SlotIndex::kBlockSlots != 0 && edge > 2 * SlotIndex::kBlockSlots) continue;
+        if (edge > 0) edges.push_back(edge - 1);
+        edges.push_back(edge);
+        edges.push_back(edge + 1);
+    }
+    for (std::size_t begin : edges) {
+        for (std::size_t end : edges) {
+            const std::size_t expected = begin < end && begin < size
+                                             ? before[std::min(end, size)] - before[begin] : 0;
+            QCOMPARE(index.countLive(begin, end), expected);
+        }
+    }
+}
+
+const CounterManager::StorageMode kModes[] = {CounterManager::StorageMode::Locked,
+                                               CounterManager::StorageMode::Atomic};
+
+// No handle operation may resolve `handle`.
+void verifyStale(CounterManager &manager, CounterManager::Handle handle) {
+    CounterManager::Value value = 0;
+    QCOMPARE(manager.rowOf(handle), -1);
+    QVERIFY(!manager.valueByHandle(handle, &value));
+    QVERIFY(!manager.setByHandle(handle, 1));
+    QVERIFY(!manager.deleteByHandle(handle));
+}
+
+// handleAt() and rowOf() invert each other on every row.
+void verifyHandles(const CounterManager &manager) {
+    const int rows = manager.count();
+    for (int row = 0; row < rows; ++row) {
+        const CounterManager::Handle handle = manager.handleAt(row);
+        QVERIFY(handle != CounterManager::kNullHandle);
+        QCOMPARE(manager.rowOf(handle), row);
+        CounterManager::Value value = 0;
+        QVERIFY(manager.valueByHandle(handle, &value));
+        QCOMPARE(value, manager.counterAt(row));
+    }
+    QCOMPARE(manager.handleAt(-1), CounterManager::kNullHandle);
+    QCOMPARE(manager.handleAt(rows), CounterManager::kNullHandle);
+    QCOMPARE(manager.rowOf(CounterManager::kNullHandle), -1);
+}
+
+void verify(const CounterManager &manager, const RowModel &model) {
+    std::vector<uint64_t> ids;
+    std::vector<CounterManager::Value> values;
+    manager.getCountersWithIds(ids, values);
+    QCOMPARE(ids, model.ids);
+    QCOMPARE(values, model.values);
+    QCOMPARE(manager.count(), static_cast<int>(model.ids.size()));
+}
+
+} // namespace
+
+// Dead slots on each side of every word and block edge, a fully dead
+// block between live ones, and truncation back onto the edges.
+void CounterManagerTest::slotIndexBoundaries() {
+    const std::size_t blocks = 3;
+    const std::size_t size = blocks * SlotIndex::kBlockSlots + 1;
+    SlotIndex index;
+    LiveModel model(size, true);
+    index.reset(size);
+    verify(index, model);
+    if (QTest::currentTestFailed()) return;
+
+    for (std::size_t slot : {std::size_t(0), std::size_t(63), std::size_t(64), std::size_t(511),
+                             std::size_t(512), std::size_t(1023), std::size_t(1024), size - 1}) {
+        index.kill(slot);
+        model[slot] = false;
+    }
+    verify(index, model);
+    if (QTest::currentTestFailed()) return;
+
+    for (std::size_t slot = SlotIndex::kBlockSlots; slot < 2 * SlotIndex::kBlockSlots; ++slot) {
+        index.setLive(slot, false);
+        model[slot] = false;
+    }
+    index.reindex(SlotIndex::kBlockSlots, 2 * SlotIndex::kBlockSlots);
+    verify(index, model);
+    if (QTest::currentTestFailed()) return;
+
+    // Dead tail down to a block edge, then down to a word edge.
+    for (std::size_t slot = 2 * SlotIndex::kBlockSlots; slot < size; ++slot) {
+        if (model[slot]) index.kill(slot);
+    }
+    model.resize(2 * SlotIndex::kBlockSlots);
+    index.truncate(model.size());
+    verify(index, model);
+    if (QTest::currentTestFailed()) return;
+
+    model.resize(SlotIndex::kBlockSlots + 64);
+    index.truncate(model.size());
+    verify(index, model);
+    if (QTest::currentTestFailed()) return;
+
+    // Appends refill the freed block and open new ones.
+    for (std::size_t i = 0; i < 2 * SlotIndex::kBlockSlots; ++i) {
+        index.append();
+        model.push_back(true);
+    }
+    verify(index, model);
+}
+
+void CounterManagerTest::slotIndexRandom() {
+    std::mt19937 random(12345);
+    SlotIndex index;
+    LiveModel model(1000, true);
+    index.reset(model.size());
+
+    for (int step = 0; step < 400; ++step) {
+        const std::size_t size = model.size();
+        switch (random() % 5) {
+        case 0: {
+            const std::size_t count = 1 + random() % 600;
+            for (std::size_t i = 0; i < count; ++i) {
+                index.append();
+                model.push_back(true);
+            }
+            break;
+        }
+        case 1:
+            for (int i = 0; i < 50 && size > 0; ++i) {
+                const std::size_t slot = random() % size;
+                if (model[slot]) {
+                    index.kill(slot);
+                    model[slot] = false;
+                }
+            }
+            break;
+        case 2: {
+            // A compaction step: flip bits over a range, reindex it once.
+            if (size == 0) break;
+            const std::size_t begin = random() % size;
+            const std::size_t end = std::min(size, begin + 1 + random() % 1200);
+            for (std::size_t slot = begin; slot < end; ++slot) {
+                const bool live = random() % 3 != 0;
+                index.setLive(slot, live);
+                model[slot] = live;
+            }
+            index.reindex(begin, end);
+            break;
+        }
+        case 3: {
+            // Drop part of the dead tail.
+            std::size_t keep = size;
+            while (keep > 0 && !model[keep - 1]) --keep;
+            keep += random() % (size - keep + 1);
+            index.truncate(keep);
+            model.resize(keep);
+            break;
+        }
+        default:
+            if (random() % 20 == 0) {
+                model.assign(random() % 2000, true);
+                index.reset(model.size());
+            }
+            break;
+        }
+
+        verify(index, model);
+        if (QTest::currentTestFailed()) {
+            qWarning("SlotIndex diverged from the model at step %d", step);
+            return;
+        }
+    }
+}
+
+// Random adds, deletes (single rows and runs longer than a block), sets and
+// bounded compaction steps must leave the rows a shifting vector would.
+void CounterManagerTest::compactStepRandom() {
+    for (auto mode : kModes) {
+        std::mt19937 random(777);
+        CounterManager manager(mode);
+        RowModel model;
+        for (int i = 0; i < 1500; ++i) {
+            model.ids.push_back(i + 1);
+            model.values.push_back(i);
+        }
+        manager.setCounters(model.values);
+        uint64_t nextId = model.ids.size() + 1;
+
+        for (int step = 0; step < 600; ++step) {
+            const std::size_t rows = model.ids.size();
+            switch (random() % 5) {
+            case 0: {
+                const CounterManager::Value value = random() % 1000;
+                manager.addCounter(value);
+                model.ids.push_back(nextId++);
+                model.values.push_back(value);
+                break;
+            }
+            case 1:
+                if (rows == 0) break;
+                for (int i = 0; i < 20 && !model.ids.empty(); ++i) {
+                    const std::size_t row = random() % model.ids.size();
+                    manager.deleteCounter(static_cast<int>(row));
+                    model.ids.erase(model.ids.begin() + row);
+                    model.values.erase(model.values.begin() + row);
+                }
+                break;
+            case 2: {
+                if (rows == 0) break;
+                const std::size_t row = random() % rows;
+                const std::size_t count = std::min<std::size_t>(rows - row, random() % 700);
+                for (std::size_t i = 0; i < count; ++i) {
+                    manager.deleteCounter(static_cast<int>(row));
+                }
+                model.ids.erase(model.ids.begin() + row, model.ids.begin() + row + count);
+                model.values.erase(model.values.begin() + row, model.values.begin() + row + count);
+                break;
+            }
+            case 3:
+                if (rows == 0) break;
+                {
+                    const std::size_t row = random() % rows;
+                    manager.setCounter(static_cast<int>(row), -step);
+                    model.values[row] = -step;
+                }
+                break;
+            default:
+                manager.compactStep(1 + random() % 700);
+                break;
+            }
+
+            verify(manager, model);
+            if (QTest::currentTestFailed()) {
+                qWarning("Manager diverged from the model at step %d", step);
+                return;
+            }
+        }
+
+        while (manager.compactStep(100)) {
+        }
+        QCOMPARE(manager.tombstoneCount(), std::size_t(0));
+        verify(manager, model);
+        if (QTest::currentTestFailed()) return;
+    }
+}
+
+void CounterManagerTest::handleStaleAfterDelete() {
+    for (auto mode : kModes) {
+        CounterManager manager(mode);
+        manager.setCounters({10, 11, 12, 13});
+        const CounterManager::Handle deleted = manager.handleAt(1);
+        const CounterManager::Handle next = manager.handleAt(2);
+
+        manager.deleteCounter(1);
+        verifyStale(manager, deleted);
+        if (QTest::currentTestFailed()) return;
+        QCOMPARE(manager.rowOf(next), 1);
+
+        // The freed entry is reused with a new generation.
+        const CounterManager::Handle added = manager.addCounter(14);
+        QVERIFY(added != deleted);
+        verifyStale(manager, deleted);
+        if (QTest::currentTestFailed()) return;
+        QCOMPARE(manager.rowOf(added), 3);
+
+        QVERIFY(manager.deleteByHandle(next));
+        verifyStale(manager, next);
+        if (QTest::currentTestFailed()) return;
+    }
+}
+
+void CounterManagerTest::handleStaleAfterSetCounters() {
+    for (auto mode : kModes) {
+        CounterManager manager(mode);
+        manager.setCounters({1, 2, 3});
+        std::vector<CounterManager::Handle> before;
+        for (int row = 0; row < manager.count(); ++row) {
+            before.push_back(manager.handleAt(row));
+        }
+
+        manager.setCounters({4, 5, 6});
+        for (CounterManager::Handle handle : before) {
+            verifyStale(manager, handle);
+            if (QTest::currentTestFailed()) return;
+        }
+        verifyHandles(manager);
+        if (QTest::currentTestFailed()) return;
+    }
+}
+
+// Compaction moves live counters into the slots of deleted ones. Their
+// handles follow them; the deleted counters' handles must not resolve to
+// whatever now sits in their old slot.
+void CounterManagerTest::handleStaleAfterCompaction() {
+    for (auto mode : kModes) {
+        CounterManager manager(mode);
+        manager.setCounters(std::vector<CounterManager::Value>(2 * SlotIndex::kBlockSlots, 7));
+        std::vector<CounterManager::Handle> deleted;
+        for (int i = 0; i < 100; ++i) {
+            deleted.push_back(manager.handleAt(0));
+            manager.deleteCounter(0);
+        }
+        const CounterManager::Handle moved = manager.handleAt(0);
+        QVERIFY(manager.setByHandle(moved, 99));
+
+        while (manager.compactStep(64)) {
+        }
+        QCOMPARE(manager.tombstoneCount(), std::size_t(0));
+        for (CounterManager::Handle handle : deleted) {
+            verifyStale(manager, handle);
+            if (QTest::currentTestFailed()) return;
+        }
+        QCOMPARE(manager.rowOf(moved), 0);
+        CounterManager::Value value = 0;
+        QVERIFY(manager.valueByHandle(moved, &value));
+        QCOMPARE(value, CounterManager::Value(99));
+        verifyHandles(manager);
+        if (QTest::currentTestFailed()) return;
+    }
+}
+
+// An entry whose generation cannot be bumped again is retired rather than
+// wrapped back to a generation an old handle may still carry.
+void CounterManagerTest::handleRetiredGeneration() {
+    for (auto mode : kModes) {
+        CounterManager manager(mode);
+        manager.setCounters({1});
+        const CounterManager::Handle first = manager.handleAt(0);
+        const std::size_t entry = static_cast<std::size_t>(first & 0xffffffffu);
+
+        const uint32_t last = std::numeric_limits<uint32_t>::max();
+        manager.handleEntries_[entry].generation = last;
+        manager.handles_[0] = static_cast<CounterManager::Handle>(last) << 32 | entry;
+        const CounterManager::Handle exhausted = manager.handleAt(0);
+        QCOMPARE(manager.rowOf(exhausted), 0);
+
+        QVERIFY(manager.deleteByHandle(exhausted));
+        const CounterManager::Handle added = manager.addCounter(2);
+        QVERIFY((added & 0xffffffffu) != entry);
+        verifyStale(manager, exhausted);
+        if (QTest::currentTestFailed()) return;
+        verifyStale(manager, first);
+        if (QTest::currentTestFailed()) return;
+        verifyStale(manager, static_cast<CounterManager::Handle>(1) << 32 | entry);
+        if (QTest::currentTestFailed()) return;
+        QCOMPARE(manager.rowOf(added), 0);
+    }
+}
+
+void CounterManagerTest::handleRowRoundTrip() {
+    for (auto mode : kModes) {
+        std::mt19937 random(99);
+        CounterManager manager(mode);
+        manager.setCounters(std::vector<CounterManager::Value>(1500, 0));
+        for (int step = 0; step < 200; ++step) {
+            const int rows = manager.count();
+            switch (random() % 4) {
+            case 0:
+                for (int i = 0; i < 20; ++i) manager.addCounter(step);
+                break;
+            case 1:
+                for (int i = 0; i < 20 && manager.count() > 0; ++i) {
+                    manager.deleteCounter(static_cast<int>(random() % manager.count()));
+                }
+                break;
+            case 2:
+                if (rows > 0) manager.deleteByHandle(manager.handleAt(static_cast<int>(random() % rows)));
+                break;
+            default:
+                manager.compactStep(1 + random() % 600);
+                break;
+            }
+            verifyHandles(manager);
+            if (QTest::currentTestFailed()) {
+                qWarning("Handles diverged at step %d", step);
+                return;
+            }
+        }
+    }
+}
+
+QTEST_GUILESS_MAIN(CounterManagerTest)
+
+#include "tst_countermanager.moc"
@@ -0,0 +1,400 @@
+#include "chunkedcounterstore.h"
+#include "counterjournal.h"
+#include "counterstore.h"
+#include "mappedcounterstore.h"
+
+#include <QtTest>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QTemporaryDir>
+
+#include <map>
+#include <memory>
+#include <vector>
+
+// Crash-safety checks for the counter stores: a store that stops half way
+// must still reload every counter, with either its old or its new value.
+class PersistenceTest : public QObject {
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+
+    void sqliteInterruptedCheckpoint();
+    void chunkedInterruptedCheckpoint();
+    void mappedInterruptedSave();
+    void journalEditRacingCompaction();
+    void failedLoadKeepsRows();
+    void chunkedUnreadableTableKept();
+    void chunkedMigrationKeepsLegacyTable();
+
+private:
+    static constexpr int kCounters = 10000;
+
+    QString openDatabase(const QString &file, const QString &options = QString());
+
+    QTemporaryDir dir_;
+    QStringList connections_;
+};
+
+namespace {
+
+std::vector<CounterManager::Value> iota(int count) {
+    std::vector<CounterManager::Value> values(count);
+    for (int i = 0; i < count; ++i) {
+        values[i] = i;
+    }
+    return values;
+}
+
+std::map<uint64_t, CounterManager::Value> contents(const CounterManager &manager) {
+    std::vector<uint64_t> ids;
+    std::vector<CounterManager::Value> values;
+    manager.getCountersWithIds(ids, values);
+    std::map<uint64_t, CounterManager::Value> counters;
+    for (std::size_t i = 0; i < ids.size(); ++i) {
+        counters[ids[i]] = values[i];
+    }
+    return counters;
+}
+
+QByteArray readFile(const QString &path) {
+    QFile file(path);
+    return file.open(QIODevice::ReadOnly) ? file.readAll() : QByteArray();
+}
+
+bool writeFile(const QString &path, const QByteArray &data) {
+    QFile file(path);
+    return file.open(QIODevice::WriteOnly) && file.write(data) == data.size();
+}
+
+} // namespace
+
+void PersistenceTest::init() {
+    QVERIFY(dir_.isValid());
+}
+
+void PersistenceTest::cleanup() {
+    for (const QString &name : connections_) {
+        QSqlDatabase::removeDatabase(name);
+    }
+    connections_.clear();
+}
+
+QString PersistenceTest::openDatabase(const QString &file, const QString &options) {
+    const QString name = QString("test%1").arg(connections_.size());
+    QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", name);
+    db.setDatabaseName(dir_.filePath(file));
+    db.setConnectOptions(options);
+    connections_ << name;
+    return db.open() ? name : QString();
+}
+
+// An unsynced store (as after journal recovery or a failed write) gets a
+// checkpoint that stops after a few rows, then the process "crashes".
+void PersistenceTest::sqliteInterruptedCheckpoint() {
+    const QString connection = openDatabase("rows.db");
+    QVERIFY(!connection.isEmpty());
+
+    CounterManager manager;
+    manager.setCounters(iota(kCounters));
+    QString error;
+    {
+        CounterStore store(connection);
+        QVERIFY2(store.save(manager, nullptr, &error), qPrintable(error));
+    }
+
+    manager.incrementAll();
+    manager.deleteCounter(kCounters / 2);
+    {
+        CounterStore store(connection);
+        store.invalidate();
+        CounterBackend::SaveStats stats;
+        QVERIFY2(store.checkpoint(manager, 5, &stats, &error), qPrintable(error));
+        QVERIFY(!stats.complete);
+        QCOMPARE(stats.rows, qint64(5));
+    }
+
+    CounterManager reloaded;
+    CounterStore store(connection);
+    QVERIFY2(store.load(reloaded, &error), qPrintable(error));
+    std::vector<uint64_t> ids;
+    std::vector<CounterManager::Value> values;
+    reloaded.getCountersWithIds(ids, values);
+    // The deleted id may or may not be gone yet; every other counter is.
+    QVERIFY(ids.size() == std::size_t(kCounters) || ids.size() == std::size_t(kCounters - 1));
+    for (std::size_t i = 0; i < ids.size(); ++i) {
+        const CounterManager::Value old = static_cast<CounterManager::Value>(ids[i] - 1);
+        QVERIFY(values[i] == old || values[i] == old + 1);
+    }
+
+    CounterBackend::SaveStats stats;
+    do {
+        QVERIFY2(store.checkpoint(manager, 1000, &stats, &error), qPrintable(error));
+    } while (!stats.complete);
+    CounterManager finished;
+    QVERIFY2(store.load(finished, &error), qPrintable(error));
+    QCOMPARE(finished.getCounters(), manager.getCounters());
+}
+
+// Chunks are positional, so a delete shifts every chunk behind it. Bounded
+// checkpoints after deletes and appends, from a synced and from a fresh
+// store, must never leave a table that loads with duplicate or lost ids.
+void PersistenceTest::chunkedInterruptedCheckpoint() {
+    const QString connection = openDatabase("chunks.db");
+    QVERIFY(!connection.isEmpty());
+
+    CounterManager manager;
+    manager.setCounters(iota(kCounters));
+    QString error;
+    ChunkedCounterStore synced(connection);
+    QVERIFY2(synced.save(manager, nullptr, &error), qPrintable(error));
+    std::map<uint64_t, CounterManager::Value> before = contents(manager);
+
+    for (int round = 0; round < 3; ++round) {
+        manager.incrementAll();
+        if (round == 1) {
+            for (int i = 0; i < kCounters; ++i) {
+                manager.addCounter(-1);
+            }
+        } else {
+            manager.deleteCounter(round == 0 ? 100 : kCounters / 2);
+        }
+        const std::map<uint64_t, CounterManager::Value> after = contents(manager);
+
+        ChunkedCounterStore fresh(connection);
+        fresh.invalidate();
+        ChunkedCounterStore &store = round == 2 ? fresh : synced;
+        QVERIFY2(store.checkpoint(manager, 1, nullptr, &error), qPrintable(error));
+
+        CounterManager reloaded;
+        ChunkedCounterStore reader(connection);
+        QVERIFY2(reader.load(reloaded, &error), qPrintable(error));
+        const std::map<uint64_t, CounterManager::Value> loaded = contents(reloaded);
+        QCOMPARE(loaded.size(), std::size_t(reloaded.count()));
+        // Every counter still live was saved before or after, never lost.
+        for (const auto &counter : before) {
+            QVERIFY(loaded.count(counter.first) == 1 || after.count(counter.first) == 0);
+        }
+        for (const auto &counter : loaded) {
+            const auto old = before.find(counter.first);
+            const auto now = after.find(counter.first);
+            QVERIFY((old != before.end() && old->second == counter.second)
+                    || (now != after.end() && now->second == counter.second));
+        }
+        before = loaded;
+    }
+
+    ChunkedCounterStore store(connection);
+    CounterBackend::SaveStats stats;
+    do {
+        QVERIFY2(store.checkpoint(manager, 1, &stats, &error), qPrintable(error));
+    } while (!stats.complete);
+    CounterManager finished;
+    QVERIFY2(store.load(finished, &error), qPrintable(error));
+    QCOMPARE(contents(finished), contents(manager));
+}
+
+// Replays part of a save's writes on top of the file it started from, as a
+// crash would leave it: the previous image must load until the header slot
+// is complete. A file that fails to load must never be saved over.
+void PersistenceTest::mappedInterruptedSave() {
+    const QString path = dir_.filePath("counters.bin");
+    CounterManager manager;
+    manager.setCounters(iota(kCounters));
+    QString error;
+    {
+        MappedCounterStore store(path);
+        QVERIFY2(store.save(manager, nullptr, &error), qPrintable(error));
+        manager.incrementAll();
+        QVERIFY2(store.save(manager, nullptr, &error), qPrintable(error));
+    }
+    const QByteArray before = readFile(path);
+    const std::map<uint64_t, CounterManager::Value> old = contents(manager);
+
+    manager.incrementAll();
+    manager.deleteCounter(kCounters / 2);
+    {
+        MappedCounterStore store(path);
+        QVERIFY2(store.save(manager, nullptr, &error), qPrintable(error));
+    }
+    const QByteArray after = readFile(path);
+    QCOMPARE(after.size(), before.size());
+
+    // Records are synced before the header slot that flips to them.
+    std::vector<int> recordBytes;
+    std::vector<int> headerBytes;
+    for (int i = 0; i < after.size(); ++i) {
+        if (after[i] != before[i]) {
+            (std::size_t(i) < MappedCounterStore::kHeaderSize ? headerBytes : recordBytes).push_back(i);
+        }
+    }
+    QVERIFY(!recordBytes.empty() && !headerBytes.empty());
+
+    const std::size_t cuts[] = {recordBytes.size() / 2, recordBytes.size(),
+                                recordBytes.size() + headerBytes.size() / 2};
+    for (std::size_t cut : cuts) {
+        QByteArray partial = before;
+        for (std::size_t i = 0; i < cut; ++i) {
+            const int at = i < recordBytes.size() ? recordBytes[i] : headerBytes[i - recordBytes.size()];
+            partial[at] = after[at];
+        }
+        QVERIFY(writeFile(path, partial));
+        CounterManager reloaded;
+        MappedCounterStore store(path);
+        QVERIFY2(store.load(reloaded, &error), qPrintable(error));
+        QCOMPARE(contents(reloaded), old);
+    }
+
+    QVERIFY(writeFile(path, after));
+    {
+        CounterManager reloaded;
+        MappedCounterStore store(path);
+        QVERIFY2(store.load(reloaded, &error), qPrintable(error));
+        QCOMPARE(contents(reloaded), contents(manager));
+    }
+
+    QByteArray corrupt = after;
+    for (int i = MappedCounterStore::kHeaderSize; i < corrupt.size(); ++i) {
+        corrupt[i] = static_cast<char>(~corrupt[i]);
+    }
+    QVERIFY(writeFile(path, corrupt));
+    CounterManager reloaded;
+    MappedCounterStore store(path);
+    QVERIFY(!store.load(reloaded, &error));
+    QVERIFY(!store.save(manager, nullptr, &error));
+    QCOMPARE(readFile(path), corrupt);
+}
+
+// An edit still waiting for its group commit when compact() rotates lands
+// in the new segment. The snapshot already includes it and the increments
+// after it, so recovery must not replay it.
+void PersistenceTest::journalEditRacingCompaction() {
+    const QString directory = dir_.filePath("journal");
+    CounterManager manager;
+    manager.setCounters(iota(10));
+    QString error;
+    {
+        // Commits only on close, so the Set is still pending at compact().
+        CounterJournal journal(directory, 60 * 1000);
+        QVERIFY2(journal.compact(manager, &error), qPrintable(error));
+        QVERIFY2(journal.open(&error), qPrintable(error));
+        manager.setObserver(&journal);
+        manager.setCounter(3, 100);
+        manager.incrementAll();
+        QVERIFY2(journal.compact(manager, &error), qPrintable(error));
+        manager.setCounter(4, 200);
+        manager.setObserver(nullptr);
+        journal.close();
+        QVERIFY(!journal.failed());
+    }
+
+    CounterJournal journal(directory);
+    std::vector<uint64_t> ids;
+    std::vector<CounterManager::Value> values;
+    QVERIFY2(journal.recover(ids, values, &error), qPrintable(error));
+    QCOMPARE(values.size(), std::size_t(10));
+    QCOMPARE(values[3], CounterManager::Value(101));
+    QCOMPARE(values[4], CounterManager::Value(200));
+}
+
+// A load that fails (here: another connection holds the database) leaves
+// the manager empty. A checkpoint after it must not diff that empty
+// manager against the table and delete the stored rows.
+void PersistenceTest::failedLoadKeepsRows() {
+    CounterManager manager;
+    manager.setCounters(iota(kCounters));
+
+    auto check = [&](const QString &file, auto makeStore) {
+        const QString connection = openDatabase(file, "QSQLITE_BUSY_TIMEOUT=0");
+        const QString locker = openDatabase(file);
+        QVERIFY(!connection.isEmpty() && !locker.isEmpty());
+        QString error;
+        {
+            auto store = makeStore(connection);
+            QVERIFY2(store->save(manager, nullptr, &error), qPrintable(error));
+        }
+
+        auto store = makeStore(connection);
+        CounterManager empty;
+        QSqlQuery lock(QSqlDatabase::database(locker));
+        QVERIFY(lock.exec("BEGIN EXCLUSIVE"));
+        QVERIFY(!store->load(empty, &error));
+        QVERIFY(lock.exec("COMMIT"));
+
+        CounterBackend::SaveStats stats;
+        QVERIFY(!store->checkpoint(empty, 1000, &stats, &error));
+        QVERIFY(!store->save(empty, &stats, &error));
+
+        CounterManager reloaded;
+        QVERIFY2(makeStore(connection)->load(reloaded, &error), qPrintable(error));
+        QCOMPARE(reloaded.getCounters(), manager.getCounters());
+    };
+    check("failed-rows.db", [](const QString &c) { return std::make_unique<CounterStore>(c); });
+    check("failed-chunks.db", [](const QString &c) { return std::make_unique<ChunkedCounterStore>(c); });
+}
+
+// An unsynced chunked store that cannot read counter_chunks must report
+// that instead of clearing the table and writing the manager over it.
+void PersistenceTest::chunkedUnreadableTableKept() {
+    const QString connection = openDatabase("unreadable.db");
+    QVERIFY(!connection.isEmpty());
+
+    CounterManager manager;
+    manager.setCounters(iota(kCounters));
+    QString error;
+    ChunkedCounterStore store(connection);
+    QVERIFY2(store.save(manager, nullptr, &error), qPrintable(error));
+
+    QSqlQuery query(QSqlDatabase::database(connection));
+    QVERIFY(query.exec("UPDATE counter_chunks SET counter_values = x'00' WHERE chunk = 1"));
+    QVERIFY(query.exec("SELECT COUNT(*) FROM counter_chunks") && query.next());
+    const qlonglong chunks = query.value(0).toLongLong();
+    query.finish();
+
+    CounterManager other;
+    other.setCounters(iota(10));
+    store.invalidate();
+    QVERIFY(!store.save(other, nullptr, &error));
+    QVERIFY(!store.checkpoint(other, 1000, nullptr, &error));
+
+    QVERIFY(query.exec("SELECT COUNT(*) FROM counter_chunks") && query.next());
+    QCOMPARE(query.value(0).toLongLong(), chunks);
+}
+
+// Migrating to chunks keeps the per-row table under another name, and the
+// per-row store then refuses the database instead of starting empty.
+void PersistenceTest::chunkedMigrationKeepsLegacyTable() {
+    const QString connection = openDatabase("migrated.db");
+    QVERIFY(!connection.isEmpty());
+
+    CounterManager manager;
+    manager.setCounters(iota(kCounters));
+    QString error;
+    {
+        CounterStore store(connection);
+        QVERIFY2(store.save(manager, nullptr, &error), qPrintable(error));
+    }
+
+    CounterManager chunked;
+    {
+        ChunkedCounterStore store(connection);
+        QVERIFY2(store.load(chunked, &error), qPrintable(error));
+    }
+    QCOMPARE(contents(chunked), contents(manager));
+
+    QSqlQuery query(QSqlDatabase::database(connection));
+    QVERIFY(query.exec("SELECT COUNT(*) FROM counters_premigration") && query.next());
+    QCOMPARE(query.value(0).toLongLong(), qlonglong(kCounters));
+    query.finish();
+
+    CounterManager rows;
+    CounterStore store(connection);
+    QVERIFY(!store.load(rows, &error));
+    QVERIFY(!store.save(manager, nullptr, &error));
+}
+
+QTEST_GUILESS_MAIN(PersistenceTest)
+
+#include "tst_persistence.moc"
@@ -0,0 +1,133 @@
+#include "tickscheduler.h"
+
+#include <algorithm>
+#include <thread>
+
+namespace {
+
+// How long before the deadline Hybrid mode stops sleeping and starts to
+// spin; covers typical Linux timer slack plus wakeup latency.
+constexpr std::chrono::microseconds kSpinWindow(200);
+
+inline void cpuRelax() {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_ia32_pause();
+#endif
+}
+
+int64_t periodFromRate(double rateHz) {
+    rateHz = std::clamp(rateHz, TickScheduler::kMinRateHz, TickScheduler::kMaxRateHz);
+    return static_cast<int64_t>(1e9 / rateHz);
+}
+
+} // namespace
+
+TickScheduler::TickScheduler(double rateHz, CatchUp catchUp, WaitMode waitMode)
+    : catchUp_(catchUp),
+      waitMode_(waitMode),
+      periodNs_(periodFromRate(rateHz)) {
+}
+
+void TickScheduler::setRate(double rateHz) {
+    periodNs_.store(periodFromRate(rateHz), std::memory_order_relaxed);
+    interrupt();
+}
+
+void TickScheduler::interrupt() {
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex_);
+        interrupted_.store(true, std::memory_order_relaxed);
+    }
+    wake_.notify_all();
+}
+
+bool TickScheduler::takeInterrupt() {
+    return interrupted_.load(std::memory_order_relaxed)
+           && interrupted_.exchange(false, std::memory_order_relaxed);
+}
+
+double TickScheduler::rate() const {
+    return 1e9 / periodNs_.load(std::memory_order_relaxed);
+}
+
+void TickScheduler::restart() {
+    started_ = false;
+}
+
+bool TickScheduler::waitNextTick() {
+    const int64_t periodNs = periodNs_.load(std::memory_order_relaxed);
+    const std::chrono::nanoseconds period(periodNs);
+
+    if (!started_ || periodNs != appliedPeriodNs_) {
+        // First tick or rate change: restart the deadline grid from now.
+        started_ = true;
+        appliedPeriodNs_ = periodNs;
+        next_ = Clock::now() + period;
+    }
+
+    if (!waitUntil(next_)) return false;
+    const Clock::time_point now = Clock::now();
+    const int64_t latenessNs = std::max<int64_t>(
+        0, std::chrono::duration_cast<std::chrono::nanoseconds>(now - next_).count());
+
+    ticks_.fetch_add(1, std::memory_order_relaxed);
+    latenessSumNs_.fetch_add(latenessNs, std::memory_order_relaxed);
+    int64_t max = latenessMaxNs_.load(std::memory_order_relaxed);
+    while (latenessNs > max
+           && !latenessMaxNs_.compare_exchange_weak(max, latenessNs, std::memory_order_relaxed)) {
+    }
+
+    next_ += period;
+    if (now < next_) return true;
+
+    // Already past the following deadline: apply the catch-up policy.
+    const int64_t behind = (now - next_) / period + 1;
+    const bool overBudget = behind * periodNs > 1000000000LL;
+    if (catchUp_ == CatchUp::Skip || overBudget) {
+        next_ += behind * period;
+        missed_.fetch_add(static_cast<uint64_t>(behind), std::memory_order_relaxed);
+    }
+    return true;
+}
+
+TickScheduler::Stats TickScheduler::takeStats() {
+    Stats stats;
+    stats.ticks = ticks_.exchange(0, std::memory_order_relaxed);
+    stats.missed = missed_.exchange(0, std::memory_order_relaxed);
+    const int64_t sumNs = latenessSumNs_.exchange(0, std::memory_order_relaxed);
+    const int64_t maxNs = latenessMaxNs_.exchange(0, std::memory_order_relaxed);
+    stats.meanLatenessUs = stats.ticks ? sumNs / 1000.0 / stats.ticks : 0.0;
+    stats.maxLatenessUs = maxNs / 1000.0;
+    return stats;
+}
+
+TickScheduler::Stats TickScheduler::merge(const Stats &a, const Stats &b) {
+    Stats merged;
+    merged.ticks = a.ticks + b.ticks;
+    merged.missed = a.missed + b.missed;
+    if (merged.ticks) {
+        merged.meanLatenessUs = (a.meanLatenessUs * a.ticks + b.meanLatenessUs * b.ticks) / merged.ticks;
+    }
+    merged.maxLatenessUs = std::max(a.maxLatenessUs, b.maxLatenessUs);
+    return merged;
+}
+
+// Returns false as soon as an interrupt() is pending. Sleeps wait on the
+// condition variable instead of sleep_until(), so at 1 Hz a stop does not
+// hang for up to a second.
+bool TickScheduler::waitUntil(Clock::time_point deadline) {
+    const Clock::time_point sleepUntil = waitMode_ == WaitMode::Hybrid ? deadline - kSpinWindow : deadline;
+    if (waitMode_ != WaitMode::Spin && Clock::now() < sleepUntil) {
+        std::unique_lock<std::mutex> lock(wakeMutex_);
+        wake_.wait_until(lock, sleepUntil, [this]() {
+            return interrupted_.load(std::memory_order_relaxed);
+        });
+    }
+    if (waitMode_ == WaitMode::Sleep) return !takeInterrupt();
+
+    while (Clock::now() < deadline) {
+        if (takeInterrupt()) return false;
+        cpuRelax();
+    }
+    return !takeInterrupt();
+}
@@ -0,0 +1,98 @@
+#ifndef TICKSCHEDULER_H
+#define TICKSCHEDULER_H
+
+#include <QtGlobal>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+// Paces a worker loop against absolute deadlines (start + n * period), so
+// the time spent in the tick body and the sleep granularity do not
+// accumulate into drift. One scheduler per thread; stats, rate changes and
+// interrupt() may come from any thread.
+class TickScheduler {
+     Q_DISABLE_COPY(TickScheduler)
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr double kMinRateHz = 1.0;
+    static constexpr double kMaxRateHz = 100000.0;
+
+    enum class CatchUp {
+        // Run missed ticks back to back so the long-run rate stays exact.
+        // Backlogs longer than one second are dropped and counted as missed.
+        Burst,
+        // Drop missed ticks and realign to the next deadline.
+        Skip
+    };
+
+    enum class WaitMode {
+        // Sleep until the deadline; cheap, jitter bounded by the OS timer.
+        Sleep,
+        // Sleep until shortly before the deadline, then spin.
+        Hybrid,
+        // Spin for the whole period; lowest jitter, burns a core.
+        Spin
+    };
+
+    // Window statistics since the previous takeStats() call.
+    struct Stats {
+        uint64_t ticks = 0;
+        uint64_t missed = 0;
+        double meanLatenessUs = 0;
+        double maxLatenessUs = 0;
+    };
+
+    explicit TickScheduler(double rateHz = 1000.0,
+                           CatchUp catchUp = CatchUp::Burst,
+                           WaitMode waitMode = WaitMode::Sleep);
+
+    // Also interrupts a pending wait, so a slow old rate does not delay
+    // the new one by up to a period.
+    void setRate(double rateHz);
+    double rate() const;
+
+    // Starts a fresh deadline grid on the next tick, e.g. when a worker
+    // (re)starts and the old grid would look like a huge backlog.
+    void restart();
+
+    // Blocks until the next deadline and records how late it woke up.
+    // Returns false without counting a tick if interrupt() cut the wait
+    // short; the caller should recheck why it is waiting.
+    bool waitNextTick();
+
+    // Wakes the thread in waitNextTick(), or makes its next call return at
+    // once, e.g. to stop or pause a worker at a low tick rate.
+    void interrupt();
+
+    // Returns and resets the window statistics.
+    Stats takeStats();
+
+    static Stats merge(const Stats &a, const Stats &b);
+
+private:
+    bool waitUntil(Clock::time_point deadline);
+    bool takeInterrupt();
+
+    const CatchUp catchUp_;
+    const WaitMode waitMode_;
+    std::atomic<int64_t> periodNs_;
+
+    bool started_ = false;
+    int64_t appliedPeriodNs_ = 0;
+    Clock::time_point next_;
+
+    std::mutex wakeMutex_;
+    std::condition_variable wake_;
+    std::atomic<bool> interrupted_{false};
+
+    std::atomic<uint64_t> ticks_{0};
+    std::atomic<uint64_t> missed_{0};
+    std::atomic<int64_t> latenessSumNs_{0};
+    std::atomic<int64_t> latenessMaxNs_{0};
+};
+
+#endif // TICKSCHEDULER_H